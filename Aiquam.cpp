@@ -6,39 +6,44 @@
 
 Aiquam::~Aiquam() = default;
 
-Aiquam::Aiquam(std::shared_ptr<Config> config, int gpu_id): config(config), gpu_id(gpu_id) {
+Aiquam::Aiquam(std::shared_ptr<Config> config, std::shared_ptr<SessionRegistry> registry, int gpu_id):
+    config(config), gpu_id(gpu_id), registry(registry), models(registry->Sessions(gpu_id)),
+    memory_info(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)) {
     logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("Aiquam"));
 
-    session_options.SetIntraOpNumThreads(1);
-    session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
-
-#ifdef USE_CUDA
-    if (gpu_id >= 0) {
-      Ort::ThrowOnError(OrtSessionOptionsAppendExecutionProvider_CUDA(
-          session_options, gpu_id));
-    }
-#endif
-
-    for (const auto& model : config->Models()) {
-        const char* model_path_cstr = model.name.c_str();
-        sessions.emplace_back(env, model_path_cstr, session_options);
+    bindings.reserve(models.sessions.size());
+    for (size_t model_index = 0; model_index < models.sessions.size(); model_index++) {
+        const model_layout &layout = models.layouts[model_index];
+        bindings.emplace_back(models.sessions[model_index]);
+
+        model_io &io = bindings.back();
+        io.inputShape = layout.inputShape;
+        io.outputShape = layout.outputShape;
+        if (layout.fixedBatch) {
+            size_t values = 1;
+            for (size_t d = 1; d < layout.inputShape.size(); d++) {
+                values *= std::max<int64_t>(layout.inputShape[d], 1);
+            }
+            io.padded.resize(layout.batchSize * values);
+        }
+        if (layout.floatOutput) {
+            io.floatResults.resize(layout.batchSize * layout.classes);
+        } else {
+            io.intResults.resize(layout.batchSize * layout.classes);
+        }
     }
 }
 
-int Aiquam::majority_vote() {
-    std::unordered_map<int, int> frequencyMap;
+// The most frequent label, the first of the ties in the order of the models
+int Aiquam::majority_vote(const std::vector<int64_t> &labels) {
+    int mostFrequent = labels[0];
+    long maxCount = 0;
 
-    for (int num : predictions) {
-        frequencyMap[num]++;
-    }
-
-    int mostFrequent = predictions[0];
-    int maxCount = 0;
-
-    for (const auto& pair : frequencyMap) {
-        if (pair.second > maxCount) {
-            maxCount = pair.second;
-            mostFrequent = pair.first;
+    for (size_t i = 0; i < labels.size(); i++) {
+        long count = std::count(labels.begin() + i, labels.end(), labels[i]);
+        if (count > maxCount) {
+            maxCount = count;
+            mostFrequent = labels[i];
         }
     }
 
@@ -46,67 +51,93 @@ int Aiquam::majority_vote() {
 }
 
 template <typename T>
-void Aiquam::softmax(T& input) {
-    float rowmax = *std::max_element(input.begin(), input.end());
-    std::vector<float> y(input.size());
+void Aiquam::softmax(T *input, size_t size) {
+    float rowmax = *std::max_element(input, input + size);
     float sum = 0.0f;
-    for (size_t i = 0; i != input.size(); ++i) {
-        sum += y[i] = std::exp(input[i] - rowmax);
+    for (size_t i = 0; i != size; ++i) {
+        sum += input[i] = std::exp(input[i] - rowmax);
     }
-    for (size_t i = 0; i != input.size(); ++i) {
-        input[i] = y[i] / sum;
+    for (size_t i = 0; i != size; ++i) {
+        input[i] = input[i] / sum;
     }
 }
 
+// Runs the model once on the n samples. The input tensor is a view on the series of the areas, which the
+// session only reads, the output one the buffer of the thread, both without copies. Only a batch shorter
+// than the fixed batch axis of a model is copied, padded to it, the predictions of the padding being dropped.
 template <typename T>
-void Aiquam::processOutputTensor(Ort::Session& session, std::vector<float> input_data, config_model model) {
-    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+void Aiquam::processOutputTensor(Ort::Session& session, const model_layout &layout, model_io &io, std::vector<T> &results, const float *input_data, size_t n, size_t size, int64_t *predicted) {
+    size_t classes = layout.classes;
+
+    size_t rows = n;
+    if (layout.fixedBatch && n < layout.batchSize) {
+        rows = layout.batchSize;
+        io.padded.resize(rows * size);
+        std::copy(input_data, input_data + n * size, io.padded.begin());
+        std::fill(io.padded.begin() + n * size, io.padded.end(), 0.0f);
+        input_data = io.padded.data();
+    }
 
-    const char* input_name = model.input.c_str();
-    std::vector<int64_t> input_shape = model.input_shape;
-    const char* output_name = model.output.c_str();
-    const char* output_type = model.output_type.c_str();
-    std::vector<int64_t> output_shape = model.output_shape;
+    if (io.bound != rows) {
+        io.outputShape[0] = rows;
+        io.output = Ort::Value::CreateTensor<T>(memory_info, results.data(), rows * classes, io.outputShape.data(), io.outputShape.size());
+        io.binding.BindOutput(layout.output, io.output);
+        io.bound = rows;
+    }
 
-    std::vector<T> results(output_shape.back());
-    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(memory_info, input_data.data(), input_data.size(), input_shape.data(), input_shape.size());
-    Ort::Value output_tensors = Ort::Value::CreateTensor<T>(memory_info, results.data(), results.size(), output_shape.data(), output_shape.size());
+    io.inputShape[0] = rows;
+    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(memory_info, const_cast<float *>(input_data), rows * size, io.inputShape.data(), io.inputShape.size());
+    io.binding.BindInput(layout.input, input_tensor);
 
-    session.Run(Ort::RunOptions{nullptr}, &input_name, &input_tensor, 1, &output_name, &output_tensors, 1);
+    session.Run(run_options, io.binding);
 
-    int64_t predicted_class;
-    if (results.size() > 1) {
-        softmax(results);
-        predicted_class = std::distance(results.begin(), std::max_element(results.begin(), results.end()));
-    } else {
-        predicted_class = results[0];
+    for (size_t sample = 0; sample < n; sample++) {
+        T *row = results.data() + sample * classes;
+        if (classes > 1) {
+            softmax(row, classes);
+            predicted[sample] = std::distance(row, std::max_element(row, row + classes));
+        } else {
+            predicted[sample] = row[0];
+        }
     }
-
-    predictions.push_back(predicted_class);
 }
 
-void Aiquam::runInference(Ort::Session& session, std::vector<float> input_data, config_model model) {
-    if (model.output_type == "float") {
-        processOutputTensor<float>(session, input_data, model);
-    } else if (model.output_type == "int64_t") {
-        processOutputTensor<int64_t>(session, input_data, model);
+void Aiquam::runInference(size_t model_index, const float *input_data, size_t n, size_t size, int64_t *predicted) {
+    const model_layout &layout = models.layouts[model_index];
+    model_io &io = bindings[model_index];
+    if (layout.floatOutput) {
+        processOutputTensor<float>(models.sessions[model_index], layout, io, io.floatResults, input_data, n, size, predicted);
     } else {
-        throw std::runtime_error("Unsupported output type");
+        processOutputTensor<int64_t>(models.sessions[model_index], layout, io, io.intResults, input_data, n, size, predicted);
     }
 }
 
-int Aiquam::inference(std::vector<float> input_data) {
-    predictions.clear();
-    size_t model_index = 0;
-    for (auto& model : config->Models()) {
-        LOG4CPLUS_DEBUG(logger, "Running inference with model: " + model.name);
+int Aiquam::inference(const float *input_data, size_t size) {
+    int predicted_class;
+    inference(input_data, 1, size, &predicted_class);
+    return predicted_class;
+}
+
+void Aiquam::inference(const float *input_data, size_t n, size_t size, int *predicted) {
+    size_t nModels = config->Models().size();
+    predictions.resize(nModels * n);
 
-        Ort::Session& session = sessions[model_index++];
-        runInference(session, input_data, model);
+    for (size_t model_index = 0; model_index < nModels; model_index++) {
+        size_t batchSize = models.layouts[model_index].batchSize;
+        LOG4CPLUS_DEBUG(logger, "Running inference with model: " << config->Models()[model_index].name << " on " << n << " samples, " << batchSize << " at once");
 
-        LOG4CPLUS_DEBUG(logger, model.name << ": local predicted class: " << predictions.back());
+        int64_t *modelPredictions = predictions.data() + model_index * n;
+        for (size_t first = 0; first < n; first += batchSize) {
+            size_t count = std::min(batchSize, n - first);
+            runInference(model_index, input_data + first * size, count, size, modelPredictions + first);
+        }
     }
 
-    int predicted_class = majority_vote();
-    return predicted_class;
+    votes.resize(nModels);
+    for (size_t sample = 0; sample < n; sample++) {
+        for (size_t model_index = 0; model_index < nModels; model_index++) {
+            votes[model_index] = predictions[model_index * n + sample];
+        }
+        predicted[sample] = majority_vote(votes);
+    }
 }
\ No newline at end of file
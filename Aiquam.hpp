@@ -12,29 +12,56 @@
 #include "onnxruntime_cxx_api.h"
 
 #include "Config.hpp"
+#include "SessionRegistry.hpp"
 
+// The ensemble of a thread: the sessions are the ones of the registry, shared with the other threads,
+// only the bindings and the buffers of the predictions are its own
 class Aiquam {
 public:
-    Aiquam(std::shared_ptr<Config>, int gpu_id = -1);
+    Aiquam(std::shared_ptr<Config>, std::shared_ptr<SessionRegistry>, int gpu_id = -1);
     ~Aiquam();
 
-    int inference(std::vector<float>);
+    int inference(const float *input_data, size_t size);
+
+    // Predicts the classes of n samples of size values each, one after the other in input_data
+    void inference(const float *input_data, size_t n, size_t size, int *predicted);
 
 private:
+    // The binding of a model: the input is a view on the samples of the batch, the output a buffer of a batch
+    // of the thread, bound again only when the length of the batch changes
+    struct model_io {
+        explicit model_io(Ort::Session &session): binding(session) {}
+
+        Ort::IoBinding binding;
+        Ort::Value output{nullptr};
+        std::vector<int64_t> inputShape;
+        std::vector<int64_t> outputShape;
+        std::vector<float> floatResults;
+        std::vector<int64_t> intResults;
+        // The samples of a batch shorter than the fixed batch axis of the model, followed by zeros
+        std::vector<float> padded;
+        size_t bound = 0;
+    };
+
     log4cplus::Logger logger;
     std::shared_ptr<Config> config;
     int gpu_id;
 
-    Ort::Env env;
-    Ort::SessionOptions session_options;
-    std::vector<Ort::Session> sessions;
+    std::shared_ptr<SessionRegistry> registry;
+    model_sessions &models;
+
+    Ort::MemoryInfo memory_info;
+    Ort::RunOptions run_options;
+    std::vector<model_io> bindings;
 
+    // The classes predicted by each model for the samples of a batch, model after model
     std::vector<int64_t> predictions;
+    std::vector<int64_t> votes;
 
-    int majority_vote();
-    template <typename T> void softmax(T& input);
-    template <typename T> void processOutputTensor(Ort::Session&, std::vector<float>, config_model);
-    void runInference(Ort::Session&, std::vector<float>, config_model);
+    int majority_vote(const std::vector<int64_t> &labels);
+    template <typename T> void softmax(T *input, size_t size);
+    template <typename T> void processOutputTensor(Ort::Session&, const model_layout &, model_io &, std::vector<T> &, const float *, size_t, size_t, int64_t *);
+    void runInference(size_t, const float *, size_t, size_t, int64_t *);
 };
 
 #endif //AIQUAMPLUSPLUS_AIQUAMM_HPP
\ No newline at end of file
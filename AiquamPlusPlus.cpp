@@ -12,47 +12,178 @@ AiquamPlusPlus::AiquamPlusPlus(std::shared_ptr<Config> config): config(config) {
     areas = std::make_shared<Areas>();
 }
 
-// Function to serialize the struct into a buffer
-void AiquamPlusPlus::serialize(const area_data& data, std::vector<char>& buffer) {
-    size_t total_size = sizeof(data.i) + sizeof(data.j) + sizeof(size_t) + data.values.size() * sizeof(float) + sizeof(data.prediction);
-    buffer.resize(total_size);
-    char* ptr = buffer.data();
-
-    memcpy(ptr, &data.i, sizeof(data.i));
-    ptr += sizeof(data.i);
-    
-    memcpy(ptr, &data.j, sizeof(data.j));
-    ptr += sizeof(data.j);
-    
-    size_t vec_size = data.values.size();
-    memcpy(ptr, &vec_size, sizeof(vec_size));
-    ptr += sizeof(vec_size);
-
-    memcpy(ptr, data.values.data(), vec_size * sizeof(float));
-    ptr += vec_size * sizeof(float);
-
-    memcpy(ptr, &data.prediction, sizeof(data.prediction));
+// Returns the inputs ingested by a process: the ones kept by the process 0, that is the first and the last one,
+// needed in full for the grid and the output, and the ones already in the series store, go to it,
+// while the others are split in blocks among the processes
+std::vector<int> AiquamPlusPlus::processInputs(int rank, int world_size, const std::vector<int> &onRoot) {
+    std::vector<int> pending;
+    for (int fileIdx = 0; fileIdx < (int)onRoot.size(); fileIdx++) {
+        if (!onRoot[fileIdx]) {
+            pending.push_back(fileIdx);
+        }
+    }
+
+    int inputsPerProcess = pending.size() / world_size;
+    int spare = pending.size() % world_size;
+    int first = rank * inputsPerProcess + std::min(rank, spare);
+    int count = inputsPerProcess + (rank < spare ? 1 : 0);
+    std::vector<int> inputs(pending.begin() + first, pending.begin() + first + count);
+
+    if (rank == 0) {
+        for (int fileIdx = 0; fileIdx < (int)onRoot.size(); fileIdx++) {
+            if (onRoot[fileIdx]) {
+                inputs.push_back(fileIdx);
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+    }
+    return inputs;
 }
 
-// Function to deserialize the buffer back into the struct
-void AiquamPlusPlus::deserialize(const std::vector<char>& buffer, area_data& data) {
-    const char* ptr = buffer.data();
+// Fills, for each cell, one column per input with its depth-integrated concentration, the series being
+// a row-major matrix of cells x inputs.
+// The inputs are ingested concurrently: each thread reads one file at a time under the I/O lock
+// and inflates and reduces it while the next thread reads, so at most ingestThreads files are in flight.
+// The first input comes from the already loaded adapter, which is replaced by the last input since
+// that one is saved with the predictions. The inputs with a slot in the series store are copied from it.
+void AiquamPlusPlus::ingest(const std::vector<int> &inputs, const std::vector<std::array<int, 2>> &cells, float *series, shared_ptr<WacommAdapter> &wacommAdapter, SeriesStore *store, const std::vector<int> &storeSlots) {
+    int ompMaxThreads = 1, world_rank = 0;
+    int ncInputs = config->NcInputs().size();
+    size_t nColumns = inputs.size();
+
+#ifdef USE_OMP
+    ompMaxThreads = omp_get_max_threads();
+#endif
+
+#ifdef USE_MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+#endif
+
+    int ingestThreads = config->IngestThreads() > 0 ? config->IngestThreads() : ompMaxThreads;
+    shared_ptr<WacommAdapter> firstAdapter = wacommAdapter;
+    shared_ptr<WacommAdapter> lastAdapter = wacommAdapter;
 
-    memcpy(&data.i, ptr, sizeof(data.i));
-    ptr += sizeof(data.i);
+    // The grid of the first input, if loaded, is shared by the adapters of the others
+    std::shared_ptr<const wacomm_grid> grid = firstAdapter ? firstAdapter->Grid() : nullptr;
 
-    memcpy(&data.j, ptr, sizeof(data.j));
-    ptr += sizeof(data.j);
+    #pragma omp parallel num_threads(ingestThreads) default(none) shared(ncInputs, nColumns, world_rank, inputs, cells, series, firstAdapter, lastAdapter, grid, store, storeSlots)
+    {
+        // Each thread reuses its adapter, and so its grid and buffers, for all its inputs
+        shared_ptr<WacommAdapter> adapter;
+        std::vector<float> field;
+
+        #pragma omp for schedule(dynamic, 1)
+        for (size_t col = 0; col < nColumns; col++) {
+            int fileIdx = inputs[col];
+            std::string& ncInput = config->NcInputs()[fileIdx];
+
+            std::vector<float> cellValues(cells.size());
+            shared_ptr<WacommAdapter> loaded;
+            if (store && storeSlots[fileIdx] >= 0) {
+                const float *column = store->column(storeSlots[fileIdx]);
+                std::copy(column, column + cells.size(), cellValues.begin());
+            } else if (fileIdx == 0 && firstAdapter) {
+                loaded = firstAdapter;
+            } else {
+                LOG4CPLUS_INFO(logger, world_rank << ": Input from Ocean Model: " << ncInput);
+
+                if (adapter) {
+                    adapter->FileName(ncInput);
+                } else {
+                    adapter = make_shared<WacommAdapter>(ncInput);
+                    adapter->Grid(grid);
+                }
 
-    size_t vec_size;
-    memcpy(&vec_size, ptr, sizeof(vec_size));
-    ptr += sizeof(vec_size);
+                if (fileIdx == ncInputs - 1 || config->IngestMode() == "full") {
+                    adapter->process();
+                    loaded = adapter;
+                    if (fileIdx == ncInputs - 1) {
+                        // The last input is kept for the output
+                        lastAdapter = adapter;
+                        adapter.reset();
+                    }
+                } else {
+                    // Only the columns under the area cells are needed
+                    adapter->processCells(cells, cellValues);
+                }
+            }
 
-    data.values.resize(vec_size);
-    memcpy(data.values.data(), ptr, vec_size * sizeof(float));
-    ptr += vec_size * sizeof(float);
+            if (loaded) {
+                // Gather the cells from the depth-integrated field of the whole input
+                size_t dimLon = loaded->Conc().N4();
+                field.resize(loaded->Conc().Nz() * dimLon);
+                loaded->integrateConc(field.data());
+                for (size_t idx = 0; idx < cells.size(); idx++) {
+                    cellValues[idx] = field[cells[idx][0] * dimLon + cells[idx][1]];
+                }
+            }
 
-    memcpy(&data.prediction, ptr, sizeof(data.prediction));
+            for (size_t idx = 0; idx < cells.size(); idx++) {
+                series[idx * nColumns + col] = cellValues[idx];
+            }
+        }
+    }
+
+    wacommAdapter = lastAdapter;
+
+    // The buffers of the adapters dropped are not needed anymore
+    conc_alloc::Release();
+}
+
+// Keeps the inputs ingested by all the processes, but not yet in the series store, in the store of the process 0
+void AiquamPlusPlus::storeSeries(SeriesStore *store, int useStore, const std::vector<int> &onRoot, const std::vector<int> &storeSlots, const std::vector<int> &inputs, const float *series, size_t nCells) {
+    int world_size = 1, world_rank = 0;
+
+#ifdef USE_MPI
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+#endif
+
+    if (!useStore) {
+        return;
+    }
+
+    std::vector<std::vector<int>> allInputs(world_size);
+    for (int i = 0; i < world_size; i++) {
+        allInputs[i] = processInputs(i, world_size, onRoot);
+    }
+
+    // The series of the other processes, one block of nCells x inputs per process
+    std::vector<float> others;
+    std::vector<int> counts(world_size), offsets(world_size);
+#ifdef USE_MPI
+    for (int i = 0; i < world_size; i++) {
+        counts[i] = (i > 0) ? nCells * allInputs[i].size() : 0;
+        offsets[i] = (i > 0) ? (offsets[i - 1] + counts[i - 1]) : 0;
+    }
+    if (world_rank == 0) {
+        others.resize(offsets[world_size - 1] + counts[world_size - 1]);
+    }
+    MPI_Gatherv(series, world_rank > 0 ? nCells * inputs.size() : 0, MPI_FLOAT,
+                others.data(), counts.data(), offsets.data(), MPI_FLOAT, 0, MPI_COMM_WORLD);
+#endif
+
+    if (world_rank != 0 || !store) {
+        return;
+    }
+
+    int stored = 0;
+    std::vector<float> values(nCells);
+    for (int i = 0; i < world_size; i++) {
+        const float *block = (i > 0) ? others.data() + offsets[i] : series;
+        size_t nColumns = allInputs[i].size();
+        for (size_t col = 0; col < nColumns; col++) {
+            int fileIdx = allInputs[i][col];
+            if (storeSlots[fileIdx] >= 0) {
+                continue;
+            }
+            for (size_t idx = 0; idx < nCells; idx++) {
+                values[idx] = block[idx * nColumns + col];
+            }
+            stored += store->put(config->NcInputs()[fileIdx], values.data());
+        }
+    }
+    LOG4CPLUS_INFO(logger, "Inputs added to the series store: " << stored);
 }
 
 void AiquamPlusPlus::run() {
@@ -83,125 +214,156 @@ void AiquamPlusPlus::run() {
 
     LOG4CPLUS_DEBUG(logger, "num_gpus: " << num_gpus);
 
-    // Define a vector of integers hosting the number of areas for each processor
-    std::unique_ptr<int[]> send_counts = std::make_unique<int[]>(world_size);
-
-    // Define a vector of integers hosting the displacement 0
-    std::unique_ptr<int[]> displs = std::make_unique<int[]>(world_size);
-
-    // Define the sending buffer
-    std::vector<char> sendbuf;
-
-    // Define the receiving buffer
-    std::vector<char> recvbuf;
-
     Areas *pLocalAreas;
 
     shared_ptr<WacommAdapter> wacommAdapter;
 
     Array::Array3<double> predictions;
 
-    size_t serialized_size = sizeof(double) * 2 + sizeof(size_t) + ncInputs * sizeof(float) + sizeof(int);
+    // Grid cells of the areas
+    std::vector<std::array<int, 2>> cells;
 
-    for (int fileIdx = 0; fileIdx < ncInputs; ++fileIdx) {
-        std::string& ncInput = config->NcInputs()[fileIdx];
+    if (world_rank == 0 && ncInputs > 0) {
+        std::string& ncInput = config->NcInputs()[0];
+        LOG4CPLUS_INFO(logger, world_rank << ": Input from Ocean Model: " << ncInput);
 
-        if (world_rank == 0) {
-            LOG4CPLUS_INFO(logger, world_rank << ": Input from Ocean Model: " << ncInput);
+        // The first input provides the grid for the areas
+        wacommAdapter = make_shared<WacommAdapter>(ncInput);
+        wacommAdapter->process();
 
-            wacommAdapter = make_shared<WacommAdapter>(ncInput);
-            wacommAdapter->process();
+        areas->load(config->AreasFile(), wacommAdapter);
+        nAreas = areas->size();
+        LOG4CPLUS_INFO(logger, "nAreas: " << nAreas);
 
-            if (fileIdx == 0) {
-                wacommAdapter->initializeKDTree();
-                string fileName = config->AreasFile();
+        // The areas are already unique cells
+        for (int idx = 0; idx < nAreas; idx++) {
+            cells.push_back({(int)areas->at(idx).J(), (int)areas->at(idx).I()});
+        }
+
+        size_t time = wacommAdapter->Conc().Nx();
+        size_t lat = wacommAdapter->Conc().Nz();
+        size_t lon = wacommAdapter->Conc().N4();
 
-                if (fileName.substr(fileName.find_last_of('.') + 1) == "json") {
-                    areas->loadFromJson(fileName, wacommAdapter);
-                } else if (fileName.substr(fileName.find_last_of('.') + 1) == "shp"){
-                    areas->loadFromShp(fileName, wacommAdapter);
+        // Define the final predictions matrix
+        predictions.Allocate(time, lat, lon);
+        
+        // Set the predictions matrix to 0
+        #pragma omp parallel for collapse(3) default(none) shared(time, lat, lon, predictions)
+        for (int t=0; t<time; t++) {
+            for (int j=0; j<lat; j++) {
+                for (int i=0; i<lon; i++) {
+                    predictions(t,j,i)=9.99999993e+36;
                 }
-                nAreas = areas->size();
-                LOG4CPLUS_INFO(logger, "nAreas: " << nAreas);
+            }
+        }
+    }
+
+#ifdef USE_MPI
+    // Share the cells of the areas, so that every process can ingest its inputs
+    MPI_Bcast(&nAreas, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    cells.resize(nAreas);
+    MPI_Bcast(cells.data(), 2 * nAreas, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
 
-                // Calculate the number of areas for each process
-                size_t areasPerProcess = nAreas / world_size;
-                size_t spare = nAreas % world_size;
+    // Calculate the number of areas for each process
+    size_t areasPerProcess = nAreas / world_size;
+    size_t spare = nAreas % world_size;
+    std::vector<int> areaCounts(world_size), areaDispls(world_size);
 
-                // Calculate send counts and displacements
-                for (int i = 0; i < world_size; i++) {
-                    send_counts[i] = areasPerProcess + (i < spare ? 1 : 0);
-                    displs[i] = (i > 0) ? (displs[i - 1] + send_counts[i - 1]) : 0;
-                    send_counts[i] *= serialized_size;
+    // Calculate the counts and displacements of the areas
+    for (int i = 0; i < world_size; i++) {
+        areaCounts[i] = areasPerProcess + (i < spare ? 1 : 0);
+        areaDispls[i] = (i > 0) ? (areaDispls[i - 1] + areaCounts[i - 1]) : 0;
 
-                    LOG4CPLUS_DEBUG(logger, world_rank << ": send_counts[0]=" << send_counts.get()[0] << " displ[0]=" << displs.get()[0]);
-                }
+        LOG4CPLUS_DEBUG(logger, world_rank << ": areaCounts[" << i << "]=" << areaCounts[i] << " areaDispls[" << i << "]=" << areaDispls[i]);
+    }
 
-                size_t time = wacommAdapter->Conc().Nx();
-                size_t lat = wacommAdapter->Conc().Nz();
-                size_t lon = wacommAdapter->Conc().N4();
-
-                // Define the final predictions matrix
-                predictions.Allocate(time, lat, lon);
-                
-                // Set the predictions matrix to 0
-                #pragma omp parallel for collapse(3) default(none) shared(time, lat, lon, predictions)
-                for (int t=0; t<time; t++) {
-                    for (int j=0; j<lat; j++) {
-                        for (int i=0; i<lon; i++) {
-                            predictions(t,j,i)=9.99999993e+36;
-                        }
+    // Look up the inputs of the previous runs in the series store; the first and the last one are always read
+    std::vector<int> onRoot(ncInputs, 0);
+    std::vector<int> storeSlots(ncInputs, -1);
+    std::unique_ptr<SeriesStore> store;
+    int useStore = 0;
+    if (world_rank == 0 && ncInputs > 0) {
+        onRoot.front() = onRoot.back() = 1;
+
+        if (!config->SeriesStore().empty()) {
+            store = std::make_unique<SeriesStore>(config->SeriesStore());
+            if (store->open(wacommAdapter->GridHash(), cells, ncInputs)) {
+                int cached = 0;
+                for (int fileIdx = 1; fileIdx < ncInputs - 1; fileIdx++) {
+                    storeSlots[fileIdx] = store->find(config->NcInputs()[fileIdx]);
+                    if (storeSlots[fileIdx] >= 0) {
+                        onRoot[fileIdx] = 1;
+                        cached++;
                     }
                 }
+                LOG4CPLUS_INFO(logger, "Inputs from the series store: " << cached);
+                useStore = 1;
+            } else {
+                store.reset();
             }
-
-            // Serialize the data
-            sendbuf.clear();
-            for (int idx = 0; idx < nAreas; idx++) {
-                Area& area = areas->at(idx);
-                area.addValue(wacommAdapter->calculateConc(area.J(), area.I()));
-
-                area_data data;
-                data.i = area.I();
-                data.j = area.J();
-                data.values = area.Values();
-                data.prediction = -1;
-
-                std::vector<char> serialized_data;
-                serialize(data, serialized_data);
-                sendbuf.insert(sendbuf.end(), serialized_data.begin(), serialized_data.end());
-            }
-            
-            LOG4CPLUS_DEBUG(logger, "sendbuf size: " << sendbuf.size());
         }
     }
 
 #ifdef USE_MPI
-    // Broadcast the number of areas for each process
-    MPI_Bcast(send_counts.get(), world_size, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(displs.get(), world_size, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(onRoot.data(), ncInputs, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&useStore, 1, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
 
-    // Calculate the size of data each process will receive
-    int recv_count = send_counts[world_rank];
-    recvbuf.resize(recv_count);
+    // Ingest the inputs of this process, one column per input
+    std::vector<int> inputs = processInputs(world_rank, world_size, onRoot);
+#ifdef USE_MPI
+    std::vector<float> localSeries(cells.size() * inputs.size());
+    float *series = localSeries.data();
+#else
+    // All the inputs are ingested here, straight into the series of the areas
+    areas->Steps(inputs.size());
+    float *series = areas->Series();
+#endif
+    ingest(inputs, cells, series, wacommAdapter, store.get(), storeSlots);
+    storeSeries(store.get(), useStore, onRoot, storeSlots, inputs, series, cells.size());
+    store.reset();
 
-    // Distribute the data
-    MPI_Scatterv(sendbuf.data(), send_counts.get(), displs.get(), MPI_CHAR, recvbuf.data(), recv_count, MPI_CHAR, 0, MPI_COMM_WORLD);
+#ifdef USE_MPI
+    // Transpose the series: each process sends, for the areas of every other process, the values of its inputs
+    std::vector<std::vector<int>> allInputs(world_size);
+    std::vector<int> seriesSendCounts(world_size), seriesSendDispls(world_size);
+    std::vector<int> seriesRecvCounts(world_size), seriesRecvDispls(world_size);
+    for (int i = 0; i < world_size; i++) {
+        allInputs[i] = processInputs(i, world_size, onRoot);
+        seriesSendCounts[i] = areaCounts[i] * inputs.size();
+        seriesRecvCounts[i] = areaCounts[world_rank] * allInputs[i].size();
+        seriesSendDispls[i] = (i > 0) ? (seriesSendDispls[i - 1] + seriesSendCounts[i - 1]) : 0;
+        seriesRecvDispls[i] = (i > 0) ? (seriesRecvDispls[i - 1] + seriesRecvCounts[i - 1]) : 0;
+    }
 
-    // Deserialize the data
-    std::unique_ptr<Areas>  localAreas = std::make_unique<Areas>();
-    int num_local_areas = send_counts[world_rank] / serialized_size;
+    std::vector<float> seriesSendBuf(seriesSendDispls[world_size - 1] + seriesSendCounts[world_size - 1]);
+    std::vector<float> seriesRecvBuf(seriesRecvDispls[world_size - 1] + seriesRecvCounts[world_size - 1]);
     size_t offset = 0;
-    for (int i = 0; i < num_local_areas; i++) {
-        std::vector<char> buffer(recvbuf.begin() + offset, recvbuf.begin() + offset + serialized_size);
+    for (int idx = 0; idx < nAreas; idx++) {
+        for (size_t col = 0; col < inputs.size(); col++) {
+            seriesSendBuf[offset++] = series[idx * inputs.size() + col];
+        }
+    }
 
-        area_data local_area;
-        deserialize(buffer, local_area);
+    MPI_Alltoallv(seriesSendBuf.data(), seriesSendCounts.data(), seriesSendDispls.data(), MPI_FLOAT,
+                  seriesRecvBuf.data(), seriesRecvCounts.data(), seriesRecvDispls.data(), MPI_FLOAT, MPI_COMM_WORLD);
 
-        Area area(local_area);
-        localAreas->push_back(area);
+    // Assemble the complete series of the local areas
+    std::unique_ptr<Areas>  localAreas = std::make_unique<Areas>();
+    for (int idx = 0; idx < areaCounts[world_rank]; idx++) {
+        const std::array<int, 2> &cell = cells[areaDispls[world_rank] + idx];
+        localAreas->add(cell[0], cell[1]);
+    }
+    localAreas->Steps(ncInputs);
 
-        offset += serialized_size;
+    for (int idx = 0; idx < areaCounts[world_rank]; idx++) {
+        float *values = localAreas->at(idx).Values();
+        for (int i = 0; i < world_size; i++) {
+            for (size_t col = 0; col < allInputs[i].size(); col++) {
+                values[allInputs[i][col]] = seriesRecvBuf[seriesRecvDispls[i] + idx * allInputs[i].size() + col];
+            }
+        }
     }
 
     pLocalAreas = localAreas.get();
@@ -211,35 +373,11 @@ void AiquamPlusPlus::run() {
 
     LOG4CPLUS_INFO(logger, world_rank << ": Local areas:" << pLocalAreas->size());
 
-    int areasToProcess = pLocalAreas->size();
-
-    // Get the number of areas to be processed by each thread
-    size_t areasPerThread = areasToProcess / ompMaxThreads;
-
-    // Get the number of spare areas for the thread with tidx==0
-    size_t sparePerThread = areasToProcess % ompMaxThreads;
-    
-    // Dafine an array with the number of areas to be processed by each thread
-    size_t thread_counts[ompMaxThreads];
-
-    // Define an array with the displacement of areas to be processed by each thread
-    size_t thread_displs[ompMaxThreads];
-
-    // The first thread get the spare
-    thread_counts[0] = (int)((areasPerThread + sparePerThread));
-
-    // The first tread starts from 0
-    thread_displs[0] = 0;
+    // The models are loaded once, and shared by the workers running them
+    auto registry = std::make_shared<SessionRegistry>(config, ompMaxThreads);
+    int workers = registry->Workers();
 
-    // For each available thread...
-    for (int tidx = 1; tidx < ompMaxThreads; tidx++) {
-
-        // Set the number of particles per thread
-        thread_counts[tidx] = (int)(areasPerThread);
-
-        // Set the displaement
-        thread_displs[tidx]=thread_counts[0]+areasPerThread*(tidx-1);
-    }
+    int areasToProcess = pLocalAreas->size();
 
 #ifdef USE_MPI
     MPI_Barrier(MPI_COMM_WORLD);
@@ -248,42 +386,49 @@ void AiquamPlusPlus::run() {
     auto comp_t0 = std::chrono::high_resolution_clock::now();
 #endif
 
-    #pragma omp parallel default(none) private(ompThreadNum) shared(world_rank, thread_counts, thread_displs, pLocalAreas, areasPerThread, num_gpus, serialized_size, recvbuf)
+    #pragma omp parallel num_threads(workers) default(none) private(ompThreadNum) shared(world_rank, areasToProcess, pLocalAreas, num_gpus, registry)
     {
-#ifdef USE_CUDA
-        Aiquam aiquam(config, (world_rank+ompThreadNum)%num_gpus);
-#else
-        Aiquam aiquam(config);
-#endif
-
+        ompThreadNum = 0;
+        int ompTeamSize = 1;
 #ifdef USE_OMP
         // Get the number of the current thread
         ompThreadNum = omp_get_thread_num();
+
+        // The runtime may grant fewer threads than the workers: the areas are split among the ones running
+        ompTeamSize = omp_get_num_threads();
 #endif
-        // Get the index (array pLocalParticles) of the first particle the thread must process
-        size_t first = thread_displs[ompThreadNum];
 
-        // Get the index (array pLocalParticles) of the last particle the thread must process
-        size_t last = first + thread_counts[ompThreadNum];
+#ifdef USE_CUDA
+        Aiquam aiquam(config, registry, (world_rank+ompThreadNum)%num_gpus);
+#else
+        Aiquam aiquam(config, registry);
+#endif
+        // Get the number of areas to be processed by each thread
+        size_t areasPerThread = areasToProcess / ompTeamSize;
+
+        // Get the number of spare areas for the thread with ompThreadNum==0
+        size_t sparePerThread = areasToProcess % ompTeamSize;
+
+        // Get the index (array pLocalAreas) of the first area the thread must process, the first thread getting the spare
+        size_t first = ompThreadNum == 0 ? 0 : sparePerThread + areasPerThread * ompThreadNum;
+
+        // Get the index (array pLocalAreas) of the last area the thread must process
+        size_t last = first + areasPerThread + (ompThreadNum == 0 ? sparePerThread : 0);
 
         LOG4CPLUS_DEBUG(logger, world_rank << ": ompThreadNum: " << ompThreadNum << ", first: " << first << ", last: " << last);
 
-        for (size_t idx = first; idx < last; idx++) {
-            LOG4CPLUS_DEBUG(logger, world_rank << ": ompThreadNum: " << ompThreadNum << ": idx: " << idx << ": i:" << pLocalAreas->at(idx).data().i << ", j: " << pLocalAreas->at(idx).data().j << ", values: " << pLocalAreas->at(idx).data().values.size());
+        // The series of the areas of the thread are consecutive rows, predicted a batch at a time
+        size_t steps = pLocalAreas->Steps();
+        std::vector<int> predicted(last - first);
+        if (last > first) {
+            aiquam.inference(pLocalAreas->Series() + first * steps, last - first, steps, predicted.data());
+        }
 
-            //std::vector<float> values = {494.79931640625,504.8264465332031,454.9320983886719,397.55279541015625,341.72088623046875,349.1586303710937,348.7724914550781,324.2787780761719,333.1670227050781,362.272216796875,396.6249084472656,430.06976318359375,484.9303894042969,453.0697021484375,477.3464965820313,434.7988586425781,531.5578002929688,344.17449951171875,225.81866455078125,314.5093078613281,322.84539794921875,301.417236328125,309.225830078125,282.3187866210937,268.01959228515625,289.224365234375,312.3394775390625,275.701904296875,247.72433471679688,233.9879608154297,235.0616607666016,181.0559539794922,201.79379272460935,225.74411010742188,247.97442626953125,247.18331909179688,274.9723205566406,280.5320739746094,268.0481262207031,194.05596923828125,224.49575805664065,137.5928955078125,101.20760345458984,231.069580078125,375.4364318847656,407.2272644042969,442.3384094238281,413.7304382324219,393.2890625,433.6060791015625,470.7800903320313,514.7785034179688,556.407470703125,598.1444091796875,575.6135864257812,438.1578979492188,337.7201538085937,336.3081970214844,329.26397705078125,323.6751708984375,329.8407592773437,328.40216064453125,327.1003723144531,270.5162658691406,240.3106689453125,253.34133911132807,212.14730834960935,300.3067626953125,396.8921813964844,463.1541137695313,539.9480590820312,608.8101196289062,591.9304809570312};
-            std::vector<float> values = pLocalAreas->at(idx).data().values;
-            int predicted_class = aiquam.inference(values);
-            pLocalAreas->at(idx).Prediction(predicted_class);
+        for (size_t idx = first; idx < last; idx++) {
+            Area area = pLocalAreas->at(idx);
+            area.Prediction(predicted[idx - first]);
 
-#ifdef USE_MPI
-            std::vector<char> updated_buffer;
-            serialize(pLocalAreas->at(idx).data(), updated_buffer);            
-            size_t offset = idx * serialized_size;
-            std::copy(updated_buffer.begin(), updated_buffer.end(), recvbuf.begin() + offset);
-#endif
-            
-            LOG4CPLUS_DEBUG(logger, world_rank << ": ompThreadNum: " << ompThreadNum << ": idx: " << idx << ": i:" << pLocalAreas->at(idx).data().i << ", j: " << pLocalAreas->at(idx).data().j << ", prediction: " << predicted_class << std::endl);
+            LOG4CPLUS_DEBUG(logger, world_rank << ": ompThreadNum: " << ompThreadNum << ": idx: " << idx << ": i:" << area.I() << ", j: " << area.J() << ", values: " << area.Steps() << ", prediction: " << predicted[idx - first]);
         }
 
 #ifdef USE_OMP
@@ -309,29 +454,19 @@ void AiquamPlusPlus::run() {
 #endif
 
 #ifdef USE_MPI
-    std::vector<int> recv_sizes(world_size);
-    MPI_Gather(&recv_count, 1, MPI_INT, recv_sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-    if (world_rank == 0) {
-    int total_size = std::accumulate(recv_sizes.begin(), recv_sizes.end(), 0);
-        sendbuf.resize(total_size);
+    // Only the predictions go back, the process 0 knowing the cells of all the areas
+    std::vector<int> localPredictions(pLocalAreas->size());
+    for (size_t idx = 0; idx < pLocalAreas->size(); idx++) {
+        localPredictions[idx] = pLocalAreas->at(idx).Prediction();
     }
 
-    MPI_Gatherv(recvbuf.data(), recv_count, MPI_CHAR, 
-            sendbuf.data(), recv_sizes.data(), displs.get(), MPI_CHAR, 
-            0, MPI_COMM_WORLD);
+    std::vector<int> allPredictions(world_rank == 0 ? nAreas : 0);
+    MPI_Gatherv(localPredictions.data(), localPredictions.size(), MPI_INT,
+                allPredictions.data(), areaCounts.data(), areaDispls.data(), MPI_INT, 0, MPI_COMM_WORLD);
 
     if (world_rank == 0) {
-        size_t offset = 0;
-        for (int i = 0; i < world_size; ++i) {
-            for (int j = 0; j < recv_sizes[i] / serialized_size; ++j) {
-                std::vector<char> buffer(sendbuf.begin() + offset, sendbuf.begin() + offset + serialized_size);
-                area_data area;
-                deserialize(buffer, area);
-                offset += serialized_size;
-
-                predictions(0, area.j, area.i) = area.prediction;
-            }
+        for (int idx = 0; idx < nAreas; idx++) {
+            predictions(0, cells[idx][0], cells[idx][1]) = allPredictions[idx];
         }
     }
 # else
@@ -382,14 +517,23 @@ void AiquamPlusPlus::save(const string &fileName, shared_ptr<WacommAdapter> waco
     depthVar.putVar(wacommAdapter->Depth()());
 
     netCDF::NcDim lonDim = dataFile.addDim("longitude", lon);
-    netCDF::NcVar lonVar = dataFile.addVar("longitude", netCDF::ncDouble, lonDim);
+    netCDF::NcDim latDim = dataFile.addDim("latitude", lat);
+
+    // The coordinates of a curvilinear grid are 2D, as in the input
+    std::vector<netCDF::NcDim> lonDims = {lonDim};
+    std::vector<netCDF::NcDim> latDims = {latDim};
+    if (wacommAdapter->Curvilinear()) {
+        lonDims = {latDim, lonDim};
+        latDims = {latDim, lonDim};
+    }
+
+    netCDF::NcVar lonVar = dataFile.addVar("longitude", netCDF::ncDouble, lonDims);
     lonVar.putAtt("description","Longitude");
     lonVar.putAtt("long_name","longitude");
     lonVar.putAtt("units","degrees_east");
     lonVar.putVar(wacommAdapter->Lon()());
 
-    netCDF::NcDim latDim = dataFile.addDim("latitude", lat);
-    netCDF::NcVar latVar = dataFile.addVar("latitude", netCDF::ncDouble, latDim);
+    netCDF::NcVar latVar = dataFile.addVar("latitude", netCDF::ncDouble, latDims);
     latVar.putAtt("description","Latitude");
     latVar.putAtt("long_name","latitude");
     latVar.putAtt("units","degrees_north");
@@ -14,7 +14,9 @@
 #include "WacommAdapter.hpp"
 #include "Aiquam.hpp"
 #include "Areas.hpp"
+#include "SeriesStore.hpp"
 
+#include <algorithm>
 #include <string>
 
 #ifdef USE_OMP
@@ -45,8 +47,9 @@ private:
     std::shared_ptr<Config> config;
     std::shared_ptr<Areas> areas;
 
-    void serialize(const area_data& data, std::vector<char>& buffer);
-    void deserialize(const std::vector<char>& buffer, area_data& data);
+    std::vector<int> processInputs(int rank, int world_size, const std::vector<int> &onRoot);
+    void ingest(const std::vector<int> &inputs, const std::vector<std::array<int, 2>> &cells, float *series, shared_ptr<WacommAdapter> &wacommAdapter, SeriesStore *store, const std::vector<int> &storeSlots);
+    void storeSeries(SeriesStore *store, int useStore, const std::vector<int> &onRoot, const std::vector<int> &storeSlots, const std::vector<int> &inputs, const float *series, size_t nCells);
 
     void save(const string &fileName, shared_ptr<WacommAdapter> wacommAdapter, Array::Array3<double> &predictions);
 };
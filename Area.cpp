@@ -4,48 +4,32 @@
 
 #include "Area.hpp"
 
-Area::Area(double j, double i) {
-    logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("Aiquam"));
-
-    _data.j = j;
-    _data.i = i;
-    _data.prediction = -1;
-}
-
-Area::Area(area_data data) {
-    _data = data;
+Area::Area(const int *j, const int *i, float *values, size_t steps, int *prediction):
+    j(j), i(i), values(values), steps(steps), prediction(prediction) {
 }
 
 Area::~Area() = default;
 
-area_data Area::data() {
-    return _data;
-}
-
-void Area::data(area_data data) {
-    _data = data;
-}
-
 double Area::J() const {
-    return _data.j;
+    return *j;
 }
 
 double Area::I() const {
-    return _data.i;
+    return *i;
 }
 
-void Area::addValue(float value) {
-    _data.values.push_back(value);
+float *Area::Values() const {
+    return values;
 }
 
-std::vector<float>& Area::Values() {
-    return _data.values;
+size_t Area::Steps() const {
+    return steps;
 }
 
 int Area::Prediction() const {
-    return _data.prediction;
+    return *prediction;
 }
 
 void Area::Prediction(int prediction) {
-    _data.prediction = prediction;
-}
\ No newline at end of file
+    *this->prediction = prediction;
+}
@@ -5,39 +5,29 @@
 #ifndef WACOMMPLUSPLUS_AREA_HPP
 #define WACOMMPLUSPLUS_AREA_HPP
 
-// log4cplus - https://github.com/log4cplus/log4cplus
-#include "log4cplus/configurator.h"
-#include "log4cplus/logger.h"
-#include "log4cplus/loggingmacros.h"
-
-struct area_data {
-    double i;
-    double j;
-    std::vector<float> values;
-    int prediction;
-};
+#include <cstddef>
 
+// View on the state of an area held by Areas: its cell, its series, one value per input, and its prediction.
+// It is valid until areas are added or the series are reallocated.
 class Area {
 public:
-    Area() = default;
-    Area(double j, double i);
-    Area(area_data);
+    Area(const int *j, const int *i, float *values, size_t steps, int *prediction);
     ~Area();
 
-    area_data data();
-    void data(area_data data);
-
     double J() const;
     double I() const;
 
-    void addValue(float value);
-    std::vector<float>& Values();
+    float *Values() const;
+    size_t Steps() const;
 
     int Prediction() const;
     void Prediction(int prediction);
 private:
-    log4cplus::Logger logger;
-    area_data _data{};
+    const int *j;
+    const int *i;
+    float *values;
+    size_t steps;
+    int *prediction;
 };
 
-#endif //WACOMMPLUSPLUS_AREA_HPP
\ No newline at end of file
+#endif //WACOMMPLUSPLUS_AREA_HPP
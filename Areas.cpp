@@ -3,182 +3,695 @@
 //
 
 #include "Areas.hpp"
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout of the cache: the header, then polygonOffsets, cellOffsets, the (j,i) of the cells, polygonCells, cellPolygons
+struct areas_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t fileHash;
+    uint64_t gridHash;
+    uint64_t nCells;
+    uint64_t nPolygons;
+    uint64_t nHits;
+};
+
+static const char areasCacheMagic[8] = {'A', 'I', 'Q', 'A', 'R', 'E', 'A', 'S'};
+static const uint32_t areasCacheVersion = 1;
+
+// Number of GeoJSON features read before rasterizing them
+static const size_t featureBatch = 1024;
+
+static size_t cacheSize(uint64_t nCells, uint64_t nPolygons, uint64_t nHits) {
+    return sizeof(areas_cache_header) + (nPolygons + 1 + nCells + 1) * sizeof(uint64_t) + (2 * nCells + 2 * nHits) * sizeof(int32_t);
+}
+
+GeoJsonReader::GeoJsonReader(std::function<void(feature_data&)> onFeature) : onFeature(std::move(onFeature)) {
+    pointDepth = 0;
+    nValues = 0;
+    values[0] = values[1] = 0;
+}
+
+const std::string &GeoJsonReader::Error() const { return error; }
+
+// The role of a container opening within the current one
+GeoJsonReader::container_role GeoJsonReader::childRole(bool array) const {
+    if (stack.empty()) {
+        return OTHER;
+    }
+
+    const container &parent = stack.back();
+    switch (parent.role) {
+        case FEATURES:
+            return FEATURE;
+        case COORDINATES:
+            return array ? COORDINATES : OTHER;
+        default:
+            break;
+    }
+
+    // Only the members of an object have a key
+    if (parent.array) {
+        return OTHER;
+    }
+    if (stack.size() == 1 && array && lastKey == "features") {
+        return FEATURES;
+    }
+    if (parent.role == FEATURE && array && lastKey == "bbox") {
+        return BBOX;
+    }
+    if (parent.role == FEATURE && !array && lastKey == "geometry") {
+        return GEOMETRY;
+    }
+    if (parent.role == GEOMETRY && array && lastKey == "coordinates") {
+        return COORDINATES;
+    }
+    return OTHER;
+}
+
+// A value other than a number, a string or a container
+bool GeoJsonReader::value() {
+    if (!stack.empty() && stack.back().role == FEATURES) {
+        feature = feature_data();
+        endFeature();
+    }
+    return true;
+}
+
+bool GeoJsonReader::number(double value) {
+    if (stack.empty()) {
+        return true;
+    }
+
+    container &top = stack.back();
+    if (top.role == BBOX) {
+        feature.bbox.push_back(value);
+    } else if (top.role == COORDINATES) {
+        top.point = true;
+        if (nValues < 2) {
+            values[nValues] = value;
+        }
+        nValues++;
+    } else {
+        return this->value();
+    }
+    return true;
+}
+
+bool GeoJsonReader::null() { return value(); }
+bool GeoJsonReader::boolean(bool) { return value(); }
+bool GeoJsonReader::number_integer(json::number_integer_t value) { return number((double)value); }
+bool GeoJsonReader::number_unsigned(json::number_unsigned_t value) { return number((double)value); }
+bool GeoJsonReader::number_float(json::number_float_t value, const json::string_t &) { return number(value); }
+
+bool GeoJsonReader::string(json::string_t &value) {
+    if (!stack.empty() && stack.back().role == GEOMETRY && lastKey == "type") {
+        geometryType = value;
+    }
+    return this->value();
+}
+
+bool GeoJsonReader::key(json::string_t &value) {
+    lastKey = value;
+    return true;
+}
+
+bool GeoJsonReader::start_object(std::size_t) {
+    container_role role = childRole(false);
+    if (role == FEATURE) {
+        feature = feature_data();
+    } else if (role == GEOMETRY) {
+        geometryType.clear();
+        pointDepth = 0;
+    }
+    stack.push_back({false, role, 0, false, false});
+    return true;
+}
+
+bool GeoJsonReader::end_object() {
+    container_role role = stack.back().role;
+    stack.pop_back();
+    if (role == FEATURE) {
+        endFeature();
+    } else if (role == GEOMETRY) {
+        endGeometry();
+    }
+    return true;
+}
+
+bool GeoJsonReader::start_array(std::size_t) {
+    container_role role = childRole(true);
+    int depth = 0;
+    if (role == FEATURE) {
+        feature = feature_data();
+    } else if (role == COORDINATES) {
+        depth = stack.back().role == COORDINATES ? stack.back().depth + 1 : 1;
+        nValues = 0;
+    }
+    stack.push_back({true, role, depth, false, false});
+    return true;
+}
+
+// A point adds a vertex to the ring it belongs to, the first one opening the ring
+bool GeoJsonReader::end_array() {
+    container closed = stack.back();
+    stack.pop_back();
+
+    if (closed.role == FEATURE) {
+        endFeature();
+    } else if (closed.role == COORDINATES && closed.point) {
+        pointDepth = (pointDepth == 0 || pointDepth == closed.depth) ? closed.depth : -1;
+
+        container &ring = stack.back();
+        if (ring.role == COORDINATES) {
+            if (!ring.ring) {
+                ring.ring = true;
+                feature.rings.push_back(feature.lon.size());
+            }
+            if (nValues >= 2) {
+                feature.lon.push_back(values[0]);
+                feature.lat.push_back(values[1]);
+            }
+        }
+    }
+    return true;
+}
+
+bool GeoJsonReader::parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &ex) {
+    error = ex.what();
+    return false;
+}
+
+void GeoJsonReader::endFeature() {
+    onFeature(feature);
+}
+
+// Keeps the rings only if the coordinates are the ones of a polygon or of a multipolygon
+void GeoJsonReader::endGeometry() {
+    bool valid = pointDepth == 0 ||
+                 (geometryType == "Polygon" && pointDepth == 3) ||
+                 (geometryType == "MultiPolygon" && pointDepth == 4);
+    if (!valid || (geometryType != "Polygon" && geometryType != "MultiPolygon")) {
+        feature.lon.clear();
+        feature.lat.clear();
+        feature.rings.clear();
+    }
+}
 
 Areas::Areas() {
     logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("Aiquam"));
 }
 
-bool Areas::isPointInPolygon(const area_data& p, const vector<area_data>& polygon) {
-    bool inside = false;
-    size_t n = polygon.size();
-    for (size_t i = 0, j = n - 1; i < n; j = i++) {
-        if (((polygon[i].j > p.j) != (polygon[j].j > p.j)) &&
-            (p.i < (polygon[j].i - polygon[i].i) * (p.j - polygon[i].j) / (polygon[j].j - polygon[i].j) + polygon[i].i)) {
-            inside = !inside;
+size_t Areas::size() const { return cellJ.size(); }
+bool Areas::empty() const { return cellJ.empty(); }
+
+void Areas::clear() {
+    cellJ.clear();
+    cellI.clear();
+    predictions.clear();
+    series.Deallocate();
+    steps = 0;
+}
+
+Area Areas::operator[](size_t idx) {
+    return Area(&cellJ[idx], &cellI[idx], Series() ? Series() + idx * steps : nullptr, steps, &predictions[idx]);
+}
+
+Area Areas::at(size_t idx) {
+    if (idx >= size()) {
+        throw std::out_of_range("Areas::at");
+    }
+    return (*this)[idx];
+}
+
+// Adds the area of a cell, with no prediction yet
+void Areas::add(int j, int i) {
+    cellJ.push_back(j);
+    cellI.push_back(i);
+    predictions.push_back(-1);
+}
+
+size_t Areas::Steps() const { return steps; }
+
+// Allocates the series of all the areas, zeroed, the rows aligned for vectorized reads
+void Areas::Steps(size_t value) {
+    series.Deallocate();
+    steps = value;
+    if (size() * steps > 0) {
+        series.Allocate(size(), steps, 0, 0, 64);
+        std::fill(series(), series() + size() * steps, 0.0f);
+    }
+}
+
+float *Areas::Series() { return size() * steps > 0 ? series() : nullptr; }
+
+size_t Areas::Polygons() const {
+    return polygonOffsets.empty() ? 0 : polygonOffsets.size() - 1;
+}
+
+const std::vector<size_t> &Areas::PolygonOffsets() const { return polygonOffsets; }
+const std::vector<int> &Areas::PolygonCells() const { return polygonCells; }
+const std::vector<size_t> &Areas::CellOffsets() const { return cellOffsets; }
+const std::vector<int> &Areas::CellPolygons() const { return cellPolygons; }
+
+// Makes an area of each distinct cell hit by the polygons, in order of first hit, and indexes the
+// cells of each polygon and the polygons of each cell. polygonOffsets already delimits the hits of each polygon.
+void Areas::buildIndex(const std::vector<std::array<int, 2>>& hits, size_t eta, size_t xi) {
+    std::vector<int> cellIds(eta * xi, -1);
+    polygonCells.resize(hits.size());
+    for (size_t idx = 0; idx < hits.size(); idx++) {
+        int &cellId = cellIds[hits[idx][0] * xi + hits[idx][1]];
+        if (cellId < 0) {
+            cellId = this->size();
+            add(hits[idx][0], hits[idx][1]);
+        }
+        polygonCells[idx] = cellId;
+    }
+
+    size_t nCells = this->size();
+    cellOffsets.assign(nCells + 1, 0);
+    for (int cellId : polygonCells) {
+        cellOffsets[cellId + 1]++;
+    }
+    for (size_t c = 0; c < nCells; c++) {
+        cellOffsets[c + 1] += cellOffsets[c];
+    }
+
+    cellPolygons.resize(polygonCells.size());
+    std::vector<size_t> next(cellOffsets.begin(), cellOffsets.end() - 1);
+    for (size_t p = 0; p < Polygons(); p++) {
+        for (size_t idx = polygonOffsets[p]; idx < polygonOffsets[p + 1]; idx++) {
+            cellPolygons[next[polygonCells[idx]]++] = p;
+        }
+    }
+
+    LOG4CPLUS_INFO(logger, "nPolygons: " << Polygons() << ", hits: " << hits.size() << ", nCells: " << nCells);
+}
+
+// Loads the areas from a GeoJSON or a shapefile, or from the cache saved next to it
+// by a previous run if neither the file nor the grid changed since then
+void Areas::load(const string &fileName, std::shared_ptr<WacommAdapter> wacommAdapter) {
+    string extension = fileName.substr(fileName.find_last_of('.') + 1);
+    string cacheName = fileName + ".cache";
+
+    // The shapes of a shapefile are located through its index
+    uint64_t fileHash = fnv1a(nullptr, 0);
+    bool hashed = hashFile(fileName, fileHash);
+    if (hashed && extension == "shp") {
+        hashFile(fileName.substr(0, fileName.size() - 3) + "shx", fileHash);
+    }
+
+    // The cells depend on the mask too
+    const Array::Array2<double> &mask = wacommAdapter->Mask();
+    uint64_t gridHash = fnv1a(mask(), mask.Size() * sizeof(double), wacommAdapter->GridHash());
+
+    if (hashed && loadCache(cacheName, fileHash, gridHash)) {
+        LOG4CPLUS_INFO(logger, "Areas from cache:" << cacheName << " nPolygons: " << Polygons() << ", nCells: " << size());
+        return;
+    }
+
+    if (!wacommAdapter->Rectilinear()) {
+        wacommAdapter->initializeKDTree();
+    }
+
+    if (extension == "json") {
+        loadFromJson(fileName, wacommAdapter);
+    } else if (extension == "shp") {
+        loadFromShp(fileName, wacommAdapter);
+    }
+
+    if (hashed) {
+        saveCache(cacheName, fileHash, gridHash);
+    }
+}
+
+bool Areas::loadCache(const string& cacheName, uint64_t fileHash, uint64_t gridHash) {
+    int fd = open(cacheName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(areas_cache_header)) {
+        close(fd);
+        return false;
+    }
+
+    size_t length = st.st_size;
+    void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    const char *base = static_cast<const char *>(mapped);
+    const areas_cache_header *header = reinterpret_cast<const areas_cache_header *>(base);
+    bool valid = memcmp(header->magic, areasCacheMagic, sizeof(areasCacheMagic)) == 0 &&
+                 header->version == areasCacheVersion && header->fileHash == fileHash && header->gridHash == gridHash &&
+                 length == cacheSize(header->nCells, header->nPolygons, header->nHits);
+
+    if (valid) {
+        const uint64_t *offsets = reinterpret_cast<const uint64_t *>(base + sizeof(areas_cache_header));
+        const int32_t *cells = reinterpret_cast<const int32_t *>(offsets + header->nPolygons + 1 + header->nCells + 1);
+
+        polygonOffsets.assign(offsets, offsets + header->nPolygons + 1);
+        cellOffsets.assign(offsets + header->nPolygons + 1, offsets + header->nPolygons + 1 + header->nCells + 1);
+        polygonCells.assign(cells + 2 * header->nCells, cells + 2 * header->nCells + header->nHits);
+        cellPolygons.assign(cells + 2 * header->nCells + header->nHits, cells + 2 * header->nCells + 2 * header->nHits);
+        valid = polygonOffsets.back() == header->nHits && cellOffsets.back() == header->nHits;
+
+        this->clear();
+        for (uint64_t c = 0; c < header->nCells && valid; c++) {
+            add(cells[2 * c], cells[2 * c + 1]);
         }
     }
-    return inside;
+
+    munmap(mapped, length);
+
+    if (!valid) {
+        this->clear();
+        polygonOffsets.clear();
+        polygonCells.clear();
+        cellOffsets.clear();
+        cellPolygons.clear();
+    }
+    return valid;
+}
+
+// Saves the cells and the index, writing a temporary file renamed at the end so that readers never see a partial cache
+void Areas::saveCache(const string& cacheName, uint64_t fileHash, uint64_t gridHash) {
+    areas_cache_header header{};
+    memcpy(header.magic, areasCacheMagic, sizeof(areasCacheMagic));
+    header.version = areasCacheVersion;
+    header.fileHash = fileHash;
+    header.gridHash = gridHash;
+    header.nCells = size();
+    header.nPolygons = Polygons();
+    header.nHits = polygonCells.size();
+
+    std::vector<uint64_t> offsets(polygonOffsets.begin(), polygonOffsets.end());
+    offsets.insert(offsets.end(), cellOffsets.begin(), cellOffsets.end());
+    if (offsets.size() != header.nPolygons + 1 + header.nCells + 1) {
+        return;
+    }
+
+    std::vector<int32_t> cells;
+    for (size_t c = 0; c < size(); c++) {
+        cells.push_back(cellJ[c]);
+        cells.push_back(cellI[c]);
+    }
+
+    string tmpName = cacheName + "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream file(tmpName, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    file.write(reinterpret_cast<const char *>(cells.data()), cells.size() * sizeof(int32_t));
+    file.write(reinterpret_cast<const char *>(polygonCells.data()), polygonCells.size() * sizeof(int32_t));
+    file.write(reinterpret_cast<const char *>(cellPolygons.data()), cellPolygons.size() * sizeof(int32_t));
+    file.close();
+
+    if (!file || std::rename(tmpName.c_str(), cacheName.c_str()) != 0) {
+        LOG4CPLUS_WARN(logger, "Unable to save the areas cache: " << cacheName);
+        std::remove(tmpName.c_str());
+    }
 }
 
-void Areas::calculateBoundingBox(const vector<area_data>& polygon,  double& minI, double& minJ, double& maxI, double& maxJ) {
+void Areas::calculateBoundingBox(const polygon_data& polygon, double& minJ, double& minI, double& maxJ, double& maxI) {
     minI = numeric_limits<double>::max();
     minJ = numeric_limits<double>::max();
     maxI = numeric_limits<double>::lowest();
     maxJ = numeric_limits<double>::lowest();
 
-    for (const auto& point : polygon) {
-        if (point.i < minI) minI = point.i;
-        if (point.i > maxI) maxI = point.i;
-        if (point.j < minJ) minJ = point.j;
-        if (point.j > maxJ) maxJ = point.j;
+    for (size_t idx = 0; idx < polygon.j.size(); idx++) {
+        if (polygon.i[idx] < minI) minI = polygon.i[idx];
+        if (polygon.i[idx] > maxI) maxI = polygon.i[idx];
+        if (polygon.j[idx] < minJ) minJ = polygon.j[idx];
+        if (polygon.j[idx] > maxJ) maxJ = polygon.j[idx];
     }
 }
 
+// Returns the integer part of a grid coordinate within [0, upper]
+static int clampIndex(double value, int upper) {
+    if (!(value > 0)) return 0;
+    if (value > upper) return upper;
+    return int(value);
+}
+
+// Collects, row by row, the sea cells of the bounding box inside the polygon. A cell is inside when the rings cross
+// the segment from it towards increasing j an odd number of times, so holes and multiple parts need no special care.
+// The columns are swept with an edge table: an edge is active over the columns its i range spans, and crosses each
+// of them at the same j the former point in polygon test computed, so the cells are exactly the ones it selected.
+// The mask pyramid culls the land: the bounding box, the blocks of columns and the words of the spans.
+void Areas::rasterize(const polygon_data& polygon, double minJ, double minI, double maxJ, double maxI, const MaskPyramid& pyramid, std::vector<std::array<int, 2>>& cells) {
+    struct edge {
+        size_t cur;
+        size_t prev;
+        int first;
+        int last;
+    };
+
+    cells.clear();
+    int eta = pyramid.Rows(), xi = pyramid.Columns();
+    if (eta == 0 || xi == 0) {
+        return;
+    }
+
+    // A bounding box off the grid, or all land, holds no cells
+    if (!(maxJ > -1) || !(maxI > -1) || !(minJ < eta) || !(minI < xi)) {
+        return;
+    }
+    int j0 = clampIndex(minJ, eta - 1), j1 = clampIndex(maxJ, eta - 1);
+    int i0 = clampIndex(minI, xi - 1), i1 = clampIndex(maxI, xi - 1);
+    if (pyramid.state(j0, i0, j1, i1) == MaskPyramid::LAND) {
+        return;
+    }
+
+    // Build the edge table, each ring closing on itself
+    std::vector<edge> edges;
+    size_t nVertices = polygon.j.size();
+    for (size_t r = 0; r < polygon.rings.size(); r++) {
+        size_t start = polygon.rings[r];
+        size_t end = (r + 1 < polygon.rings.size()) ? polygon.rings[r + 1] : nVertices;
+        for (size_t cur = start; cur < end; cur++) {
+            size_t prev = (cur == start) ? end - 1 : cur - 1;
+            double lo = std::min(polygon.i[cur], polygon.i[prev]);
+            double hi = std::max(polygon.i[cur], polygon.i[prev]);
+
+            // The edge crosses the columns c with lo <= c < hi
+            if (!(lo < hi)) {
+                continue;
+            }
+            double first = std::max(std::ceil(lo), (double)i0);
+            double last = std::min(std::ceil(hi) - 1, (double)i1);
+            if (first > last) {
+                continue;
+            }
+            edges.push_back({cur, prev, (int)first, (int)last});
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const edge &a, const edge &b) { return a.first < b.first; });
+
+    std::vector<edge> active;
+    std::vector<double> crossings;
+    size_t next = 0;
+    bool land = false;
+    for (int c = i0; c <= i1; c++) {
+        while (next < edges.size() && edges[next].first <= c) {
+            active.push_back(edges[next++]);
+        }
+        active.erase(std::remove_if(active.begin(), active.end(), [c](const edge &e) { return e.last < c; }), active.end());
+
+        // The columns of a block all land within the rows of the bounding box are skipped as a whole
+        if (c == i0 || c % MaskPyramid::blockSize == 0) {
+            int last = std::min(int(c - c % MaskPyramid::blockSize + MaskPyramid::blockSize - 1), i1);
+            land = pyramid.state(j0, c, j1, last) == MaskPyramid::LAND;
+        }
+        if (land) {
+            continue;
+        }
+
+        crossings.clear();
+        for (const auto &e : active) {
+            crossings.push_back((polygon.j[e.prev] - polygon.j[e.cur]) * (c - polygon.i[e.cur]) / (polygon.i[e.prev] - polygon.i[e.cur]) + polygon.j[e.cur]);
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        // The rows below exactly k crossings, crossings[k-1] <= j < crossings[k], are inside when (m - k) is odd
+        size_t m = crossings.size();
+        for (size_t k = 0; k <= m; k++) {
+            if ((m - k) % 2 == 0) {
+                continue;
+            }
+            double from = (k == 0) ? j0 : std::max(std::ceil(crossings[k - 1]), (double)j0);
+            double to = (k == m) ? j1 : std::min(std::ceil(crossings[k]) - 1, (double)j1);
+            if (from <= to) {
+                pyramid.seaCells(c, (size_t)from, (size_t)to, cells);
+            }
+        }
+    }
+
+    std::sort(cells.begin(), cells.end());
+}
+
+// Makes the polygons, in order, out of the cells of each feature, and indexes them
+void Areas::mergeCells(const std::vector<std::vector<std::array<int, 2>>>& featureCells, size_t eta, size_t xi) {
+    std::vector<std::array<int, 2>> hits;
+    for (const auto &cells : featureCells) {
+        polygonOffsets.push_back(hits.size());
+        hits.insert(hits.end(), cells.begin(), cells.end());
+    }
+    polygonOffsets.push_back(hits.size());
+
+    buildIndex(hits, eta, xi);
+}
+
+// Rasterizes a GeoJSON feature; a feature without polygons covers no cells
+void Areas::rasterizeFeature(const feature_data& feature, std::shared_ptr<WacommAdapter> wacommAdapter, const MaskPyramid& pyramid, std::vector<std::array<int, 2>>& cells) {
+    double minJ = 1e37, minI = 1e37, maxJ = 1e37, maxI = 1e37;
+    bool bboxAvailable = feature.bbox.size() == 4;
+
+    if (bboxAvailable) {
+        wacommAdapter->latlon2ji(feature.bbox[1], feature.bbox[0], minJ, minI);
+        wacommAdapter->latlon2ji(feature.bbox[3], feature.bbox[2], maxJ, maxI);
+
+        LOG4CPLUS_INFO(logger, "Bounding box: [" << minI << ", " << minJ << ", " << maxI << ", " << maxJ << "]");
+    }
+
+    if (feature.lat.empty()) {
+        return;
+    }
+
+    // Convert all the vertices at once
+    polygon_data polygon;
+    polygon.rings = feature.rings;
+    polygon.j.resize(feature.lat.size());
+    polygon.i.resize(feature.lat.size());
+    wacommAdapter->latlon2ji(feature.lat.data(), feature.lon.data(), polygon.j.data(), polygon.i.data(), feature.lat.size());
+
+    if (!bboxAvailable) {
+        calculateBoundingBox(polygon, minJ, minI, maxJ, maxI);
+        LOG4CPLUS_INFO(logger, "Bounding box calculated: [" << minI << ", " << minJ << ", " << maxI << ", " << maxJ << "]");
+    }
+
+    rasterize(polygon, minJ, minI, maxJ, maxI, pyramid, cells);
+}
+
+// Rasterizes a batch of features concurrently, appending their cells to the ones of the former batches
+void Areas::rasterizeFeatures(std::vector<feature_data>& features, std::shared_ptr<WacommAdapter> wacommAdapter, const MaskPyramid& pyramid, std::vector<std::vector<std::array<int, 2>>>& featureCells) {
+    size_t first = featureCells.size();
+    long nFeatures = features.size();
+    featureCells.resize(first + nFeatures);
+
+    #pragma omp parallel for schedule(dynamic, 8) default(none) shared(features, first, nFeatures, featureCells, wacommAdapter, pyramid)
+    for (long k = 0; k < nFeatures; k++) {
+        rasterizeFeature(features[k], wacommAdapter, pyramid, featureCells[first + k]);
+    }
+
+    features.clear();
+}
+
+// Rasterizes a polygon record of a shapefile, converting its points where they lie
+void Areas::rasterizeShape(const shape_polygon& shape, std::shared_ptr<WacommAdapter> wacommAdapter, const MaskPyramid& pyramid, polygon_data& polygon, std::vector<std::array<int, 2>>& cells) {
+    if (shape.nPoints == 0) {
+        return;
+    }
+
+    // Each part is a ring
+    polygon.rings.assign(shape.parts.begin(), shape.parts.end());
+    if (polygon.rings.empty()) {
+        polygon.rings.push_back(0);
+    }
+
+    // Convert all the vertices at once, x and y being interleaved
+    polygon.j.resize(shape.nPoints);
+    polygon.i.resize(shape.nPoints);
+    wacommAdapter->latlon2ji(shape.points + 1, shape.points, polygon.j.data(), polygon.i.data(), shape.nPoints, 2);
+
+    double minI, minJ, maxI, maxJ;
+    calculateBoundingBox(polygon, minJ, minI, maxJ, maxI);
+
+    rasterize(polygon, minJ, minI, maxJ, maxI, pyramid, cells);
+}
+
+// The features are streamed out of the file and rasterized in batches, so that only a batch is held in memory,
+// concurrently, each into its own buffer, and merged in file order
 void Areas::loadFromJson(const string &fileName, std::shared_ptr<WacommAdapter> wacommAdapter) {
     LOG4CPLUS_INFO(logger, "Reading from json:" << fileName);
 
     std::ifstream infile(fileName);
 
-    Array::Array2 mask = wacommAdapter->Mask();
-
-    try {
-        json featureCollection;
-        infile >> featureCollection;
-
-        if (featureCollection.contains("features") && featureCollection["features"].is_array()) {
-            for (auto feature:featureCollection["features"]) {
-                double minLon, minLat, maxLon, maxLat;
-                double minJ = 1e37, minI = 1e37, maxJ = 1e37, maxI = 1e37;
-                vector<area_data> polygon;
-                bool bboxAvailable = false;
-
-                if (feature.contains("bbox") && feature["bbox"].is_array() && feature["bbox"].size() == 4) {
-                    bboxAvailable = true;
-
-                    minLon = feature["bbox"][0];
-                    minLat = feature["bbox"][1];
-                    maxLon = feature["bbox"][2];
-                    maxLat = feature["bbox"][3];
-
-                    wacommAdapter->latlon2ji(minLat, minLon, minJ, minI);
-                    wacommAdapter->latlon2ji(maxLat, maxLon, maxJ, maxI);
-
-                    LOG4CPLUS_INFO(logger, "Bounding box: [" << minI << ", " << minJ << ", " << maxI << ", " << maxJ << "]");
-                }
-                
-                if (feature.contains("geometry")) {
-                    auto geometry = feature["geometry"];
-                    if (geometry.contains("type") && geometry.contains("coordinates") && geometry["coordinates"].is_array()) {
-                        auto coordinates = geometry["coordinates"];
-                        
-                        std::vector<std::vector<std::vector<double>>> polygons;
-
-                        if (geometry["type"] == "MultiPolygon") {
-                            for (auto coordinate : coordinates) {
-                                if (coordinate.is_array() && !coordinate.empty()) {
-                                    polygons.push_back(coordinate.at(0).get<std::vector<std::vector<double>>>());
-                                }
-                            }
-                        } else if (geometry["type"] == "Polygon") {
-                            polygons = coordinates.get<std::vector<std::vector<std::vector<double>>>>();
-                        }
-
-                        for (auto points : polygons) {
-                            for (auto point : points) {
-                                if (point.size() >= 2) {
-                                    double lon = point[0];
-                                    double lat = point[1];
-
-                                    double j, i;
-                                    wacommAdapter->latlon2ji(lat, lon, j, i);
-                                    polygon.push_back({j, i});
-                                }
-                            }
-                        }
-                    }
-                }
-
-                if (polygon.empty()) {
-                    continue;
-                }
-
-                if (!bboxAvailable) {
-                    calculateBoundingBox(polygon, minJ, minI, maxJ, maxI);
-                    LOG4CPLUS_INFO(logger, "Bounding box calculated: [" << minI << ", " << minJ << ", " << maxI << ", " << maxJ << "]");
-                }
-
-                for (int j = int(minJ); j <= int(maxJ); j++) {
-                    for (int i = int(minI); i <= int(maxI); i++) {
-                        if (mask(j, i) == 1) {
-                            if (isPointInPolygon({static_cast<double>(j), static_cast<double>(i)}, polygon)) {
-                                this->push_back(Area(j, i));
-                            }
-                        }
-                    }
-                }
-            }
+    const MaskPyramid &pyramid = wacommAdapter->Pyramid();
+
+    this->clear();
+    polygonOffsets.clear();
+
+    // Every feature is a polygon, even if it covers no cells
+    std::vector<std::vector<std::array<int, 2>>> featureCells;
+    std::vector<feature_data> batch;
+
+    GeoJsonReader reader([&](feature_data &feature) {
+        batch.push_back(std::move(feature));
+        if (batch.size() == featureBatch) {
+            rasterizeFeatures(batch, wacommAdapter, pyramid, featureCells);
         }
+    });
 
-    } catch (const nlohmann::json::parse_error& e) {
-        LOG4CPLUS_ERROR(logger,e.what());
+    if (!json::sax_parse(infile, &reader)) {
+        LOG4CPLUS_ERROR(logger, reader.Error());
+        return;
     }
+    rasterizeFeatures(batch, wacommAdapter, pyramid, featureCells);
+
+    mergeCells(featureCells, pyramid.Rows(), pyramid.Columns());
 }
 
+// The records are rasterized concurrently, each into its own buffer, and merged in file order. Anything
+// but a polygon, with or without z and m, covers no cells.
 void Areas::loadFromShp(const string& fileName, std::shared_ptr<WacommAdapter> wacommAdapter) {
     LOG4CPLUS_INFO(logger, "Reading from shapefile:" << fileName);
 
-    SHPHandle hSHP = SHPOpen(fileName.c_str(), "rb");
-    if (hSHP == nullptr) {
+    ShapeFile shapeFile(fileName);
+    if (!shapeFile.IsOpen()) {
         LOG4CPLUS_ERROR(logger, "Unable to open shapefile: " << fileName);
         return;
     }
 
-    int nEntities, nShapeType;
-    double adfMinBound[4], adfMaxBound[4];
-
-    SHPGetInfo(hSHP, &nEntities, &nShapeType, adfMinBound, adfMaxBound);
+    long nRecords = shapeFile.Records();
 
-    Array::Array2 mask = wacommAdapter->Mask();
+    const MaskPyramid &pyramid = wacommAdapter->Pyramid();
 
-    for (int i = 0; i < nEntities; i++) {
-        SHPObject* psShape = SHPReadObject(hSHP, i);
-        if (psShape == nullptr || psShape->nSHPType != SHPT_POLYGON) {
-            SHPDestroyObject(psShape);
-            continue;
-        }
+    this->clear();
+    polygonOffsets.clear();
 
-        vector<area_data> polygon;
-        for (int j = 0; j < psShape->nVertices; j++) {
-            double lat = psShape->padfY[j];
-            double lon = psShape->padfX[j];
+    // Every record is a polygon, even if it covers no cells
+    std::vector<std::vector<std::array<int, 2>>> featureCells(nRecords);
 
-            double pJ, pI;
-            wacommAdapter->latlon2ji(lat, lon, pJ, pI);
-            polygon.push_back({pJ, pI});
-        }
+    #pragma omp parallel default(none) shared(shapeFile, nRecords, featureCells, wacommAdapter, pyramid)
+    {
+        // The buffers of each thread are reused from a record to the next
+        shape_polygon shape;
+        polygon_data polygon;
 
-        if (polygon.empty()) {
-            SHPDestroyObject(psShape);
-            continue;
-        }
-
-        double minI, minJ, maxI, maxJ;
-        calculateBoundingBox(polygon, minJ, minI, maxJ, maxI);
-
-        for (int j = int(minJ); j <= int(maxJ); j++) {
-            for (int i = int(minI); i <= int(maxI); i++) {
-                if (mask(j, i) == 1) {
-                    if (isPointInPolygon({static_cast<double>(j), static_cast<double>(i)}, polygon)) {
-                        this->push_back(Area(j, i));
-                    }
-                }
+        #pragma omp for schedule(dynamic, 8)
+        for (long k = 0; k < nRecords; k++) {
+            if (shapeFile.polygon(k, shape)) {
+                rasterizeShape(shape, wacommAdapter, pyramid, polygon, featureCells[k]);
             }
         }
-
-        SHPDestroyObject(psShape);
     }
 
-    SHPClose(hSHP);
+    mergeCells(featureCells, pyramid.Rows(), pyramid.Columns());
 }
 
-Areas::~Areas() = default;
\ No newline at end of file
+Areas::~Areas() = default;
@@ -11,37 +11,142 @@
 #include "log4cplus/loggingmacros.h"
 #include <nlohmann/json.hpp>
 #include <fstream>
-
-#include "shapefil.h"
+#include <functional>
 
 #include "Area.hpp"
+#include "ShapeFile.hpp"
 #include "WacommAdapter.hpp"
 
 using namespace std;
 using json = nlohmann::json;
 
-class Areas : private vector<Area> {
+// A polygon in grid coordinates: the vertices of all its rings, outer boundaries and holes of every part,
+// one after the other, each ring starting at its offset
+struct polygon_data {
+    std::vector<double> j;
+    std::vector<double> i;
+    std::vector<size_t> rings;
+};
+
+// A GeoJSON feature as read from the file: the lon/lat of the vertices of all its rings, flattened as in
+// polygon_data, and its bounding box, if any
+struct feature_data {
+    std::vector<double> lon;
+    std::vector<double> lat;
+    std::vector<size_t> rings;
+    std::vector<double> bbox;
+};
+
+// Streams the features of a GeoJSON FeatureCollection, handing each one over as soon as it is read, so that
+// the file is never held in memory as a whole. Anything in the features array but an object is an empty feature.
+class GeoJsonReader {
+public:
+    explicit GeoJsonReader(std::function<void(feature_data&)> onFeature);
+
+    bool null();
+    bool boolean(bool value);
+    bool number_integer(json::number_integer_t value);
+    bool number_unsigned(json::number_unsigned_t value);
+    bool number_float(json::number_float_t value, const json::string_t &text);
+    bool string(json::string_t &value);
+    // Binary values only come from the binary formats (nlohmann >= 3.8)
+    template<typename BinaryType> bool binary(BinaryType &) { return value(); }
+    bool start_object(std::size_t elements);
+    bool key(json::string_t &value);
+    bool end_object();
+    bool start_array(std::size_t elements);
+    bool end_array();
+    bool parse_error(std::size_t position, const std::string &lastToken, const nlohmann::detail::exception &ex);
+
+    const std::string &Error() const;
+
+private:
+    // An open object or array, with the key it is the value of
+    enum container_role { OTHER, FEATURES, FEATURE, BBOX, GEOMETRY, COORDINATES };
+    struct container {
+        bool array;
+        container_role role;
+        int depth;          // Nesting within the coordinates, the coordinates themselves being 1
+        bool point;         // An array of numbers within the coordinates
+        bool ring;          // An array of points
+    };
+
+    std::function<void(feature_data&)> onFeature;
+    std::vector<container> stack;
+    std::string lastKey;
+    std::string error;
+
+    feature_data feature;
+    std::string geometryType;
+    int pointDepth;
+    size_t nValues;
+    double values[2];
+
+    container_role childRole(bool array) const;
+    bool value();
+    bool number(double value);
+    void endFeature();
+    void endGeometry();
+};
+
+// The areas, stored by field: their cells, their series as one row-major matrix of a row per area
+// and a column per input, and their predictions
+class Areas {
 public:
     Areas();
     ~Areas();
 
-    using vector::push_back;
-    using vector::operator[];
-    using vector::size;
-    using vector::at;
-    using vector::empty;
-    using vector::begin;
-    using vector::end;
-    using vector::erase;
+    size_t size() const;
+    bool empty() const;
+    void clear();
 
+    Area operator[](size_t idx);
+    Area at(size_t idx);
+    void add(int j, int i);
+
+    size_t Steps() const;
+    void Steps(size_t steps);
+    float *Series();
+
+    void load(const string &fileName, std::shared_ptr<WacommAdapter> wacommAdapter);
     void loadFromJson(const string &fileName, std::shared_ptr<WacommAdapter> wacommAdapter);
     void loadFromShp(const string &fileName, std::shared_ptr<WacommAdapter> wacommAdapter);
 
+    size_t Polygons() const;
+    const std::vector<size_t> &PolygonOffsets() const;
+    const std::vector<int> &PolygonCells() const;
+    const std::vector<size_t> &CellOffsets() const;
+    const std::vector<int> &CellPolygons() const;
+
 private:
     log4cplus::Logger logger;
 
-    bool isPointInPolygon(const area_data& p, const vector<area_data>& polygon);
-    void calculateBoundingBox(const vector<area_data>& polygon, double& minI, double& minJ, double& maxI, double& maxJ);
+    std::vector<int> cellJ;
+    std::vector<int> cellI;
+    std::vector<int> predictions;
+    Array::Array2<float> series;
+    size_t steps = 0;
+
+    // The areas are the unique cells covered by the polygons. The cells of the polygon p are
+    // polygonCells[polygonOffsets[p]..polygonOffsets[p+1]), the polygons of the cell c are
+    // cellPolygons[cellOffsets[c]..cellOffsets[c+1])
+    std::vector<size_t> polygonOffsets;
+    std::vector<int> polygonCells;
+    std::vector<size_t> cellOffsets;
+    std::vector<int> cellPolygons;
+
+    void buildIndex(const std::vector<std::array<int, 2>>& hits, size_t eta, size_t xi);
+    void mergeCells(const std::vector<std::vector<std::array<int, 2>>>& featureCells, size_t eta, size_t xi);
+
+    void rasterizeFeatures(std::vector<feature_data>& features, std::shared_ptr<WacommAdapter> wacommAdapter, const MaskPyramid& pyramid, std::vector<std::vector<std::array<int, 2>>>& featureCells);
+    void rasterizeFeature(const feature_data& feature, std::shared_ptr<WacommAdapter> wacommAdapter, const MaskPyramid& pyramid, std::vector<std::array<int, 2>>& cells);
+    void rasterizeShape(const shape_polygon& shape, std::shared_ptr<WacommAdapter> wacommAdapter, const MaskPyramid& pyramid, polygon_data& polygon, std::vector<std::array<int, 2>>& cells);
+
+    bool loadCache(const string& cacheName, uint64_t fileHash, uint64_t gridHash);
+    void saveCache(const string& cacheName, uint64_t fileHash, uint64_t gridHash);
+
+    void calculateBoundingBox(const polygon_data& polygon, double& minJ, double& minI, double& maxJ, double& maxI);
+    void rasterize(const polygon_data& polygon, double minJ, double minI, double maxJ, double maxI, const MaskPyramid& pyramid, std::vector<std::array<int, 2>>& cells);
 };
 
 #endif //AIQUAMPLUSPLUS_AREAS_HPP
\ No newline at end of file
@@ -28,6 +28,23 @@
 #include <climits>
 #include <cstdlib>
 #include <cerrno>
+#include <utility>
+#include <map>
+#include <mutex>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if __cplusplus > 201703L && defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#endif
+#endif
 
 #ifdef NDEBUG
 #define __check(i,n,dim,m)
@@ -129,12 +146,153 @@ namespace Array {
 
 #endif
 
+// Allocator policies of the arrays, their last template parameter: a policy
+// hands out the buffers by its static allocate(n,align), align being 0 when
+// none is requested, and takes them back by deallocate(v,n,aligned).
+
+    // The buffers of new [], or of newAlign when an alignment is requested
     template<class T>
+    class heap {
+    public:
+        static T *allocate(size_t n, size_t align) {
+            T *v;
+            if(align) newAlign(v,n,align);
+            else v=new T[n];
+            return v;
+        }
+        static void deallocate(T *v, size_t n, bool aligned) {
+            if(aligned) deleteAlign(v,n);
+            else delete [] v;
+        }
+    };
+
+    // Transparent huge pages: the buffers of a huge page or more are aligned
+    // to it and advised as such before being touched, the smaller ones come
+    // from the heap.
+    template<class T>
+    class hugepage {
+    public:
+        static const size_t pageSize=2*1024*1024;
+
+        static T *allocate(size_t n, size_t align) {
+            if(n*sizeof(T) < pageSize) return heap<T>::allocate(n,align);
+            void *mem=NULL;
+            if(posix_memalign(&mem,align > pageSize ? align : pageSize,n*sizeof(T)) != 0)
+                ArrayExit("Memory limits exceeded");
+#ifdef MADV_HUGEPAGE
+            madvise(mem,n*sizeof(T),MADV_HUGEPAGE);
+#endif
+            T *v=(T *) mem;
+            for(size_t i=0; i < n; i++) new(v+i) T;
+            return v;
+        }
+        static void deallocate(T *v, size_t n, bool aligned) {
+            if(n*sizeof(T) < pageSize) {
+                heap<T>::deallocate(v,n,aligned);
+                return;
+            }
+            for(size_t i=0; i < n; i++) v[i].~T();
+            free(v);
+        }
+    };
+
+    // Parallel first touch: the elements are initialized by the threads of a
+    // static schedule, so that on a NUMA node each page of the buffer lands in
+    // the memory of the thread given its part of the array by the same schedule.
+    // Within a parallel region, or without OpenMP, the loop would run on the
+    // calling thread alone, so the buffer is left as Upstream hands it out.
+    template<class T, class Upstream=heap<T> >
+    class firsttouch {
+    public:
+        static T *allocate(size_t n, size_t align) {
+            T *v=Upstream::allocate(n,align);
+#ifdef _OPENMP
+            if(!omp_in_parallel()) {
+                #pragma omp parallel for schedule(static) default(none) shared(v, n)
+                for(long i=0; i < (long) n; i++) v[i]=T();
+            }
+#endif
+            return v;
+        }
+        static void deallocate(T *v, size_t n, bool aligned) {
+            Upstream::deallocate(v,n,aligned);
+        }
+    };
+
+    // An arena of the buffers given back, reused by the following arrays of
+    // the same size and alignment, e.g. the fields of the input files read one
+    // after the other; they are returned upstream by Release() or at exit.
+    template<class T, class Upstream=heap<T> >
+    class pool {
+        struct block {
+            T *v;
+            bool aligned;
+        };
+        struct arena {
+            std::mutex mutex;
+            std::multimap<size_t,block> blocks;
+            ~arena() {
+                for(auto& b : blocks) Upstream::deallocate(b.second.v,b.first,b.second.aligned);
+            }
+        };
+        static arena& Arena() {
+            static arena a;
+            return a;
+        }
+    public:
+        static T *allocate(size_t n, size_t align) {
+            arena& a=Arena();
+            {
+                std::lock_guard<std::mutex> lock(a.mutex);
+                auto range=a.blocks.equal_range(n);
+                for(auto it=range.first; it != range.second; ++it) {
+                    const block& b=it->second;
+                    if(b.aligned == (align != 0) && (align == 0 || (size_t) b.v % align == 0)) {
+                        T *v=b.v;
+                        a.blocks.erase(it);
+                        return v;
+                    }
+                }
+            }
+            return Upstream::allocate(n,align);
+        }
+        static void deallocate(T *v, size_t n, bool aligned) {
+            arena& a=Arena();
+            std::lock_guard<std::mutex> lock(a.mutex);
+            a.blocks.insert(std::make_pair(n,block{v,aligned}));
+        }
+        static void Release() {
+            std::multimap<size_t,block> blocks;
+            {
+                arena& a=Arena();
+                std::lock_guard<std::mutex> lock(a.mutex);
+                blocks.swap(a.blocks);
+            }
+            for(auto& b : blocks) Upstream::deallocate(b.second.v,b.first,b.second.aligned);
+        }
+    };
+
+    template<class T, unsigned int rank>
+    class strided;
+
+    template<class T, class Alloc=heap<T> >
     class array1 {
     protected:
         T *v;
         unsigned int size;
         mutable int state;
+
+        // A buffer is moved only when the source owns it and the target does
+        // not view the one of another array, which is assigned to otherwise.
+        bool Movable(const array1<T,Alloc>& A) const {
+            return this != &A && A.test(allocated) && (test(allocated) || v == NULL);
+        }
+        void Take(array1<T,Alloc>& A) {
+            Deallocate();
+            v=A.v; size=A.size; state=A.state;
+            A.Release();
+        }
+        void Release() {v=NULL; size=0; state=unallocated;}
     public:
         enum alloc_state {unallocated=0, allocated=1, temporary=2, aligned=4};
         virtual unsigned int Size() const {return size;}
@@ -157,13 +315,9 @@ namespace Array {
         void clear(int flag) const {state &= ~flag;}
         void set(int flag) const {state |= flag;}
         void Activate(size_t align=0) {
-            if(align) {
-                newAlign(v,size,align);
-                set(allocated | aligned);
-            } else {
-                v=new T[size];
-                set(allocated);
-            }
+            v=Alloc::allocate(size,align);
+            if(align) set(allocated | aligned);
+            else set(allocated);
         }
         void CheckActivate(int dim, size_t align=0) {
             Deallocate();
@@ -171,8 +325,7 @@ namespace Array {
         }
         void Deallocate() const {
             if(test(allocated)) {
-                if(test(aligned)) deleteAlign(v,size);
-                else delete [] v;
+                Alloc::deallocate(v,size,test(aligned));
                 state=unallocated;
             }
         }
@@ -180,7 +333,7 @@ namespace Array {
         void Dimension(unsigned int nx0, T *v0) {
             Dimension(nx0); v=v0; clear(allocated);
         }
-        void Dimension(const array1<T>& A) {
+        void Dimension(const array1<T,Alloc>& A) {
             Dimension(A.size,A.v); state=A.test(temporary);
         }
 
@@ -205,8 +358,14 @@ namespace Array {
         }
         array1(unsigned int nx0, T *v0) : state(unallocated) {Dimension(nx0,v0);}
         array1(T *v0) : state(unallocated) {Dimension(INT_MAX,v0);}
-        array1(const array1<T>& A) : v(A.v), size(A.size),
+        array1(const array1<T,Alloc>& A) : v(A.v), size(A.size),
                                      state(A.test(temporary)) {}
+        array1(array1<T,Alloc>&& A) : v(A.v), size(A.size), state(A.state) {
+            A.Release();
+        }
+#ifdef __cpp_lib_span
+        array1(std::span<T> s) : state(unallocated) {Dimension(s.size(),s.data());}
+#endif
 
         virtual ~array1() {Deallocate();}
 
@@ -237,7 +396,7 @@ namespace Array {
 #ifdef NDEBUG
         typedef T *opt;
 #else
-        typedef array1<T> opt;
+        typedef array1<T,Alloc> opt;
 #endif
 
         T& operator [] (int ix) const {__check(ix,size,1,1); return v[ix];}
@@ -245,7 +404,15 @@ namespace Array {
         T* operator () () const {return v;}
         operator T* () const {return v;}
 
-        array1<T> operator + (int i) const {return array1<T>(size-i,v+i);}
+        array1<T,Alloc> operator + (int i) const {return array1<T,Alloc>(size-i,v+i);}
+
+        // Non-owning view of the whole array
+        array1<T,Alloc> view() const {return array1<T,Alloc>(size,v);}
+        strided<T,1> slice(int x0, unsigned int nx0) const;
+#ifdef __cpp_lib_span
+        std::span<T> span() const {return std::span<T>(v,size);}
+        operator std::span<T> () const {return span();}
+#endif
 
         void Load(T a) const {
             __checkSize();
@@ -279,9 +446,9 @@ namespace Array {
             return s;
         }
 
-        array1<T>& operator = (T a) {Load(a); return *this;}
-        array1<T>& operator = (const T *a) {Load(a); return *this;}
-        array1<T>& operator = (const array1<T>& A) {
+        array1<T,Alloc>& operator = (T a) {Load(a); return *this;}
+        array1<T,Alloc>& operator = (const T *a) {Load(a); return *this;}
+        array1<T,Alloc>& operator = (const array1<T,Alloc>& A) {
             if(size != A.Size()) {
                 Deallocate();
                 Allocate(A.Size());
@@ -290,44 +457,49 @@ namespace Array {
             A.Purge();
             return *this;
         }
+        array1<T,Alloc>& operator = (array1<T,Alloc>&& A) {
+            if(!Movable(A)) return *this=static_cast<const array1<T,Alloc>&>(A);
+            Take(A);
+            return *this;
+        }
 
-        array1<T>& operator += (const array1<T>& A) {
+        array1<T,Alloc>& operator += (const array1<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < size; i++) v[i] += A(i);
             return *this;
         }
-        array1<T>& operator -= (const array1<T>& A) {
+        array1<T,Alloc>& operator -= (const array1<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < size; i++) v[i] -= A(i);
             return *this;
         }
-        array1<T>& operator *= (const array1<T>& A) {
+        array1<T,Alloc>& operator *= (const array1<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < size; i++) v[i] *= A(i);
             return *this;
         }
-        array1<T>& operator /= (const array1<T>& A) {
+        array1<T,Alloc>& operator /= (const array1<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < size; i++) v[i] /= A(i);
             return *this;
         }
 
-        array1<T>& operator += (T a) {
+        array1<T,Alloc>& operator += (T a) {
             __checkSize();
             for(unsigned int i=0; i < size; i++) v[i] += a;
             return *this;
         }
-        array1<T>& operator -= (T a) {
+        array1<T,Alloc>& operator -= (T a) {
             __checkSize();
             for(unsigned int i=0; i < size; i++) v[i] -= a;
             return *this;
         }
-        array1<T>& operator *= (T a) {
+        array1<T,Alloc>& operator *= (T a) {
             __checkSize();
             for(unsigned int i=0; i < size; i++) v[i] *= a;
             return *this;
         }
-        array1<T>& operator /= (T a) {
+        array1<T,Alloc>& operator /= (T a) {
             __checkSize();
             T ainv=1.0/a;
             for(unsigned int i=0; i < size; i++) v[i] *= ainv;
@@ -400,8 +572,8 @@ namespace Array {
         A.Dimension(D);
     }
 
-    template<class T>
-    std::ostream& operator << (std::ostream& s, const array1<T>& A)
+    template<class T, class Alloc>
+    std::ostream& operator << (std::ostream& s, const array1<T,Alloc>& A)
     {
         T *p=A();
         for(unsigned int i=0; i < A.Nx(); i++) {
@@ -410,19 +582,89 @@ namespace Array {
         return s;
     }
 
-    template<class T>
-    std::istream& operator >> (std::istream& s, const array1<T>& A)
+    template<class T, class Alloc>
+    std::istream& operator >> (std::istream& s, const array1<T,Alloc>& A)
     {
         return A.Input(s);
     }
 
-    template<class T>
-    class array2 : public array1<T> {
+    // Non-owning view of a block of an array, indexed from 0: n[d] elements
+    // along the dimension d, step[d] elements apart, e.g. some time steps and
+    // depth levels of an array4 with all of their rows and columns.
+    template<class T, unsigned int rank>
+    class strided {
+    protected:
+        T *v;
+        unsigned int n[rank];
+        size_t step[rank];
+    public:
+        strided(T *v0, const unsigned int *n0, const size_t *step0) : v(v0) {
+            for(unsigned int d=0; d < rank; d++) {n[d]=n0[d]; step[d]=step0[d];}
+        }
+
+        void Check(int i, int n, unsigned int dim, unsigned int m) const {
+            if(i < 0 || i >= n) {
+                std::ostringstream buf;
+                buf << "Slice" << dim << " index " << m << " is out of bounds (" << i;
+                if(i < 0) buf << " < 0";
+                else buf << " > " << n-1;
+                buf << ")";
+                const std::string& s=buf.str();
+                ArrayExit(s.c_str());
+            }
+        }
+
+        unsigned int N(unsigned int d) const {return n[d];}
+        size_t Step(unsigned int d) const {return step[d];}
+        size_t Size() const {
+            size_t size=1;
+            for(unsigned int d=0; d < rank; d++) size *= n[d];
+            return size;
+        }
+
+        // The elements are one block, the one starting at operator ()()
+        bool Contiguous() const {
+            size_t size=1;
+            for(unsigned int d=rank; d-- > 0;) {
+                if(n[d] > 1 && step[d] != size) return false;
+                size *= n[d];
+            }
+            return true;
+        }
+
+        T* operator () () const {return v;}
+        template<class... I>
+        T& operator () (I... i) const {
+            static_assert(sizeof...(I) == rank,"Wrong number of slice indices");
+            const int index[]={int(i)...};
+            size_t offset=0;
+            for(unsigned int d=0; d < rank; d++) {
+                __check(index[d],n[d],rank,d+1);
+                offset += index[d]*step[d];
+            }
+            return v[offset];
+        }
+        strided<T,rank-1> operator [] (int ix) const {
+            __check(ix,n[0],rank,1);
+            return strided<T,rank-1>(v+ix*step[0],n+1,step+1);
+        }
+    };
+
+    template<class T, class Alloc>
+    strided<T,1> array1<T,Alloc>::slice(int x0, unsigned int nx0) const {
+        __check(x0,size,1,1);
+        __check(x0+(int) nx0-1,size,1,1);
+        const size_t step=1;
+        return strided<T,1>(v+x0,&nx0,&step);
+    }
+
+    template<class T, class Alloc=heap<T> >
+    class array2 : public array1<T,Alloc> {
     protected:
         unsigned int nx;
         unsigned int ny;
     public:
-        using array1<T>::Dimension;
+        using array1<T,Alloc>::Dimension;
 
         void Dimension(unsigned int nx0, unsigned int ny0) {
             nx=nx0; ny=ny0;
@@ -433,7 +675,7 @@ namespace Array {
             this->v=v0;
             this->clear(this->allocated);
         }
-        void Dimension(const array1<T> &A) {ArrayExit("Operation not implemented");}
+        void Dimension(const array1<T,Alloc> &A) {ArrayExit("Operation not implemented");}
 
         void Allocate(unsigned int nx0, unsigned int ny0, size_t align=0) {
             Dimension(nx0,ny0);
@@ -445,18 +687,36 @@ namespace Array {
             Allocate(nx0,ny0,align);
         }
         array2(unsigned int nx0, unsigned int ny0, T *v0) {Dimension(nx0,ny0,v0);}
+        array2(const array2<T,Alloc>&)=default;
+        array2(array2<T,Alloc>&& A) : array1<T,Alloc>(std::move(A)), nx(A.nx), ny(A.ny) {
+            A.nx=A.ny=0;
+        }
 
         unsigned int Nx() const {return nx;}
         unsigned int Ny() const {return ny;}
 
+        array2<T,Alloc> view() const {return array2<T,Alloc>(nx,ny,this->v);}
+        strided<T,2> slice(int x0, unsigned int nx0) const {
+            return slice(x0,nx0,0,ny);
+        }
+        strided<T,2> slice(int x0, unsigned int nx0, int y0, unsigned int ny0) const {
+            __check(x0,nx,2,1);
+            __check(x0+(int) nx0-1,nx,2,1);
+            __check(y0,ny,2,2);
+            __check(y0+(int) ny0-1,ny,2,2);
+            const unsigned int n[]={nx0,ny0};
+            const size_t step[]={ny,1};
+            return strided<T,2>(this->v+x0*ny+y0,n,step);
+        }
+
 #ifndef __NOARRAY2OPT
         T *operator [] (int ix) const {
     return this->v+ix*ny;
   }
 #else
-        array1<T> operator [] (int ix) const {
+        array1<T,Alloc> operator [] (int ix) const {
             __check(ix,nx,2,1);
-            return array1<T>(ny,this->v+ix*ny);
+            return array1<T,Alloc>(ny,this->v+ix*ny);
         }
 #endif
         T& operator () (int ix, int iy) const {
@@ -470,41 +730,48 @@ namespace Array {
         }
         T* operator () () const {return this->v;}
 
-        array2<T>& operator = (T a) {this->Load(a); return *this;}
-        array2<T>& operator = (T *a) {this->Load(a); return *this;}
-        array2<T>& operator = (const array2<T>& A) {
+        array2<T,Alloc>& operator = (T a) {this->Load(a); return *this;}
+        array2<T,Alloc>& operator = (T *a) {this->Load(a); return *this;}
+        array2<T,Alloc>& operator = (const array2<T,Alloc>& A) {
             __checkEqual(nx,A.Nx(),2,1);
             __checkEqual(ny,A.Ny(),2,2);
             this->Load(A());
             A.Purge();
             return *this;
         }
+        array2<T,Alloc>& operator = (array2<T,Alloc>&& A) {
+            if(!this->Movable(A)) return *this=static_cast<const array2<T,Alloc>&>(A);
+            this->Take(A);
+            nx=A.nx; ny=A.ny;
+            A.nx=A.ny=0;
+            return *this;
+        }
 
-        array2<T>& operator += (const array2<T>& A) {
+        array2<T,Alloc>& operator += (const array2<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < this->size; i++) this->v[i] += A(i);
             return *this;
         }
-        array2<T>& operator -= (const array2<T>& A) {
+        array2<T,Alloc>& operator -= (const array2<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < this->size; i++) this->v[i] -= A(i);
             return *this;
         }
-        array2<T>& operator *= (const array2<T>& A);
+        array2<T,Alloc>& operator *= (const array2<T,Alloc>& A);
 
-        array2<T>& operator += (T a) {
+        array2<T,Alloc>& operator += (T a) {
             __checkSize();
             unsigned int inc=ny+1;
             for(unsigned int i=0; i < this->size; i += inc) this->v[i] += a;
             return *this;
         }
-        array2<T>& operator -= (T a) {
+        array2<T,Alloc>& operator -= (T a) {
             __checkSize();
             unsigned int inc=ny+1;
             for(unsigned int i=0; i < this->size; i += inc) this->v[i] -= a;
             return *this;
         }
-        array2<T>& operator *= (T a) {
+        array2<T,Alloc>& operator *= (T a) {
             __checkSize();
             for(unsigned int i=0; i < this->size; i++) this->v[i] *= a;
             return *this;
@@ -518,8 +785,8 @@ namespace Array {
         }
     };
 
-    template<class T>
-    std::ostream& operator << (std::ostream& s, const array2<T>& A)
+    template<class T, class Alloc>
+    std::ostream& operator << (std::ostream& s, const array2<T,Alloc>& A)
     {
         T *p=A();
         for(unsigned int i=0; i < A.Nx(); i++) {
@@ -532,21 +799,21 @@ namespace Array {
         return s;
     }
 
-    template<class T>
-    std::istream& operator >> (std::istream& s, const array2<T>& A)
+    template<class T, class Alloc>
+    std::istream& operator >> (std::istream& s, const array2<T,Alloc>& A)
     {
         return A.Input(s);
     }
 
-    template<class T>
-    class array3 : public array1<T> {
+    template<class T, class Alloc=heap<T> >
+    class array3 : public array1<T,Alloc> {
     protected:
         unsigned int nx;
         unsigned int ny;
         unsigned int nz;
         unsigned int nyz;
     public:
-        using array1<T>::Dimension;
+        using array1<T,Alloc>::Dimension;
 
         void Dimension(unsigned int nx0, unsigned int ny0, unsigned int nz0) {
             nx=nx0; ny=ny0; nz=nz0; nyz=ny*nz;
@@ -572,14 +839,33 @@ namespace Array {
         array3(unsigned int nx0, unsigned int ny0, unsigned int nz0, T *v0) {
             Dimension(nx0,ny0,nz0,v0);
         }
+        array3(const array3<T,Alloc>&)=default;
+        array3(array3<T,Alloc>&& A) : array1<T,Alloc>(std::move(A)), nx(A.nx), ny(A.ny),
+                                nz(A.nz), nyz(A.nyz) {
+            A.nx=A.ny=A.nz=A.nyz=0;
+        }
 
         unsigned int Nx() const {return nx;}
         unsigned int Ny() const {return ny;}
         unsigned int Nz() const {return nz;}
 
-        array2<T> operator [] (int ix) const {
+        array3<T,Alloc> view() const {return array3<T,Alloc>(nx,ny,nz,this->v);}
+        strided<T,3> slice(int x0, unsigned int nx0) const {
+            return slice(x0,nx0,0,ny);
+        }
+        strided<T,3> slice(int x0, unsigned int nx0, int y0, unsigned int ny0) const {
+            __check(x0,nx,3,1);
+            __check(x0+(int) nx0-1,nx,3,1);
+            __check(y0,ny,3,2);
+            __check(y0+(int) ny0-1,ny,3,2);
+            const unsigned int n[]={nx0,ny0,nz};
+            const size_t step[]={nyz,nz,1};
+            return strided<T,3>(this->v+x0*nyz+y0*nz,n,step);
+        }
+
+        array2<T,Alloc> operator [] (int ix) const {
             __check(ix,nx,3,1);
-            return array2<T>(ny,nz,this->v+ix*nyz);
+            return array2<T,Alloc>(ny,nz,this->v+ix*nyz);
         }
         T& operator () (int ix, int iy, int iz) const {
             __check(ix,nx,3,1);
@@ -593,9 +879,9 @@ namespace Array {
         }
         T* operator () () const {return this->v;}
 
-        array3<T>& operator = (T a) {this->Load(a); return *this;}
-        array3<T>& operator = (T *a) {this->Load(a); return *this;}
-        array3<T>& operator = (const array3<T>& A) {
+        array3<T,Alloc>& operator = (T a) {this->Load(a); return *this;}
+        array3<T,Alloc>& operator = (T *a) {this->Load(a); return *this;}
+        array3<T,Alloc>& operator = (const array3<T,Alloc>& A) {
             __checkEqual(nx,A.Nx(),3,1);
             __checkEqual(ny,A.Ny(),3,2);
             __checkEqual(nz,A.Nz(),3,3);
@@ -603,25 +889,32 @@ namespace Array {
             A.Purge();
             return *this;
         }
+        array3<T,Alloc>& operator = (array3<T,Alloc>&& A) {
+            if(!this->Movable(A)) return *this=static_cast<const array3<T,Alloc>&>(A);
+            this->Take(A);
+            nx=A.nx; ny=A.ny; nz=A.nz; nyz=A.nyz;
+            A.nx=A.ny=A.nz=A.nyz=0;
+            return *this;
+        }
 
-        array3<T>& operator += (array3<T>& A) {
+        array3<T,Alloc>& operator += (array3<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < this->size; i++) this->v[i] += A(i);
             return *this;
         }
-        array3<T>& operator -= (array3<T>& A) {
+        array3<T,Alloc>& operator -= (array3<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < this->size; i++) this->v[i] -= A(i);
             return *this;
         }
 
-        array3<T>& operator += (T a) {
+        array3<T,Alloc>& operator += (T a) {
             __checkSize();
             unsigned int inc=nyz+nz+1;
             for(unsigned int i=0; i < this->size; i += inc) this->v[i] += a;
             return *this;
         }
-        array3<T>& operator -= (T a) {
+        array3<T,Alloc>& operator -= (T a) {
             __checkSize();
             unsigned int inc=nyz+nz+1;
             for(unsigned int i=0; i < this->size; i += inc) this->v[i] -= a;
@@ -629,8 +922,8 @@ namespace Array {
         }
     };
 
-    template<class T>
-    std::ostream& operator << (std::ostream& s, const array3<T>& A)
+    template<class T, class Alloc>
+    std::ostream& operator << (std::ostream& s, const array3<T,Alloc>& A)
     {
         T *p=A();
         for(unsigned int i=0; i < A.Nx(); i++) {
@@ -646,14 +939,14 @@ namespace Array {
         return s;
     }
 
-    template<class T>
-    std::istream& operator >> (std::istream& s, const array3<T>& A)
+    template<class T, class Alloc>
+    std::istream& operator >> (std::istream& s, const array3<T,Alloc>& A)
     {
         return A.Input(s);
     }
 
-    template<class T>
-    class array4 : public array1<T> {
+    template<class T, class Alloc=heap<T> >
+    class array4 : public array1<T,Alloc> {
     protected:
         unsigned int nx;
         unsigned int ny;
@@ -663,7 +956,7 @@ namespace Array {
         unsigned int nzw;
         unsigned int nyzw;
     public:
-        using array1<T>::Dimension;
+        using array1<T,Alloc>::Dimension;
 
         void Dimension(unsigned int nx0, unsigned int ny0, unsigned int nz0,
                        unsigned int nw0) {
@@ -690,15 +983,35 @@ namespace Array {
                unsigned int nw0, T *v0) {
             Dimension(nx0,ny0,nz0,nw0,v0);
         }
+        array4(const array4<T,Alloc>&)=default;
+        array4(array4<T,Alloc>&& A) : array1<T,Alloc>(std::move(A)), nx(A.nx), ny(A.ny),
+                                nz(A.nz), nw(A.nw), nyz(A.nyz), nzw(A.nzw),
+                                nyzw(A.nyzw) {
+            A.nx=A.ny=A.nz=A.nw=A.nyz=A.nzw=A.nyzw=0;
+        }
 
         unsigned int Nx() const {return nx;}
         unsigned int Ny() const {return ny;}
         unsigned int Nz() const {return nz;}
         unsigned int N4() const {return nw;}
 
-        array3<T> operator [] (int ix) const {
+        array4<T,Alloc> view() const {return array4<T,Alloc>(nx,ny,nz,nw,this->v);}
+        strided<T,4> slice(int x0, unsigned int nx0) const {
+            return slice(x0,nx0,0,ny);
+        }
+        strided<T,4> slice(int x0, unsigned int nx0, int y0, unsigned int ny0) const {
+            __check(x0,nx,4,1);
+            __check(x0+(int) nx0-1,nx,4,1);
+            __check(y0,ny,4,2);
+            __check(y0+(int) ny0-1,ny,4,2);
+            const unsigned int n[]={nx0,ny0,nz,nw};
+            const size_t step[]={nyzw,nzw,nw,1};
+            return strided<T,4>(this->v+x0*nyzw+y0*nzw,n,step);
+        }
+
+        array3<T,Alloc> operator [] (int ix) const {
             __check(ix,nx,3,1);
-            return array3<T>(ny,nz,nw,this->v+ix*nyzw);
+            return array3<T,Alloc>(ny,nz,nw,this->v+ix*nyzw);
         }
         T& operator () (int ix, int iy, int iz, int iw) const {
             __check(ix,nx,4,1);
@@ -713,9 +1026,9 @@ namespace Array {
         }
         T* operator () () const {return this->v;}
 
-        array4<T>& operator = (T a) {this->Load(a); return *this;}
-        array4<T>& operator = (T *a) {this->Load(a); return *this;}
-        array4<T>& operator = (const array4<T>& A) {
+        array4<T,Alloc>& operator = (T a) {this->Load(a); return *this;}
+        array4<T,Alloc>& operator = (T *a) {this->Load(a); return *this;}
+        array4<T,Alloc>& operator = (const array4<T,Alloc>& A) {
             __checkEqual(nx,A.Nx(),4,1);
             __checkEqual(ny,A.Ny(),4,2);
             __checkEqual(nz,A.Nz(),4,3);
@@ -724,25 +1037,32 @@ namespace Array {
             A.Purge();
             return *this;
         }
+        array4<T,Alloc>& operator = (array4<T,Alloc>&& A) {
+            if(!this->Movable(A)) return *this=static_cast<const array4<T,Alloc>&>(A);
+            this->Take(A);
+            nx=A.nx; ny=A.ny; nz=A.nz; nw=A.nw; nyz=A.nyz; nzw=A.nzw; nyzw=A.nyzw;
+            A.nx=A.ny=A.nz=A.nw=A.nyz=A.nzw=A.nyzw=0;
+            return *this;
+        }
 
-        array4<T>& operator += (array4<T>& A) {
+        array4<T,Alloc>& operator += (array4<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < this->size; i++) this->v[i] += A(i);
             return *this;
         }
-        array4<T>& operator -= (array4<T>& A) {
+        array4<T,Alloc>& operator -= (array4<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < this->size; i++) this->v[i] -= A(i);
             return *this;
         }
 
-        array4<T>& operator += (T a) {
+        array4<T,Alloc>& operator += (T a) {
             __checkSize();
             unsigned int inc=nyzw+nzw+nw+1;
             for(unsigned int i=0; i < this->size; i += inc) this->v[i] += a;
             return *this;
         }
-        array4<T>& operator -= (T a) {
+        array4<T,Alloc>& operator -= (T a) {
             __checkSize();
             unsigned int inc=nyzw+nzw+nw+1;
             for(unsigned int i=0; i < this->size; i += inc) this->v[i] -= a;
@@ -750,8 +1070,8 @@ namespace Array {
         }
     };
 
-    template<class T>
-    std::ostream& operator << (std::ostream& s, const array4<T>& A)
+    template<class T, class Alloc>
+    std::ostream& operator << (std::ostream& s, const array4<T,Alloc>& A)
     {
         T *p=A;
         for(unsigned int i=0; i < A.Nx(); i++) {
@@ -770,14 +1090,14 @@ namespace Array {
         return s;
     }
 
-    template<class T>
-    std::istream& operator >> (std::istream& s, const array4<T>& A)
+    template<class T, class Alloc>
+    std::istream& operator >> (std::istream& s, const array4<T,Alloc>& A)
     {
         return A.Input(s);
     }
 
-    template<class T>
-    class array5 : public array1<T> {
+    template<class T, class Alloc=heap<T> >
+    class array5 : public array1<T,Alloc> {
     protected:
         unsigned int nx;
         unsigned int ny;
@@ -788,7 +1108,7 @@ namespace Array {
         unsigned int nzwv;
         unsigned int nyzwv;
     public:
-        using array1<T>::Dimension;
+        using array1<T,Alloc>::Dimension;
 
         void Dimension(unsigned int nx0, unsigned int ny0, unsigned int nz0,
                        unsigned int nw0, unsigned int nv0) {
@@ -825,9 +1145,9 @@ namespace Array {
         unsigned int N4() const {return nw;}
         unsigned int N5() const {return nv;}
 
-        array4<T> operator [] (int ix) const {
+        array4<T,Alloc> operator [] (int ix) const {
             __check(ix,nx,4,1);
-            return array4<T>(ny,nz,nw,nv,this->v+ix*nyzwv);
+            return array4<T,Alloc>(ny,nz,nw,nv,this->v+ix*nyzwv);
         }
         T& operator () (int ix, int iy, int iz, int iw, int iv) const {
             __check(ix,nx,5,1);
@@ -843,9 +1163,9 @@ namespace Array {
         }
         T* operator () () const {return this->v;}
 
-        array5<T>& operator = (T a) {this->Load(a); return *this;}
-        array5<T>& operator = (T *a) {this->Load(a); return *this;}
-        array5<T>& operator = (const array5<T>& A) {
+        array5<T,Alloc>& operator = (T a) {this->Load(a); return *this;}
+        array5<T,Alloc>& operator = (T *a) {this->Load(a); return *this;}
+        array5<T,Alloc>& operator = (const array5<T,Alloc>& A) {
             __checkEqual(nx,A.Nx(),5,1);
             __checkEqual(ny,A.Ny(),5,2);
             __checkEqual(nz,A.Nz(),5,3);
@@ -856,24 +1176,24 @@ namespace Array {
             return *this;
         }
 
-        array5<T>& operator += (array5<T>& A) {
+        array5<T,Alloc>& operator += (array5<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < this->size; i++) this->v[i] += A(i);
             return *this;
         }
-        array5<T>& operator -= (array5<T>& A) {
+        array5<T,Alloc>& operator -= (array5<T,Alloc>& A) {
             __checkSize();
             for(unsigned int i=0; i < this->size; i++) this->v[i] -= A(i);
             return *this;
         }
 
-        array5<T>& operator += (T a) {
+        array5<T,Alloc>& operator += (T a) {
             __checkSize();
             unsigned int inc=nyzwv+nzwv+nwv+nv+1;
             for(unsigned int i=0; i < this->size; i += inc) this->v[i] += a;
             return *this;
         }
-        array5<T>& operator -= (T a) {
+        array5<T,Alloc>& operator -= (T a) {
             __checkSize();
             unsigned int inc=nyzwv+nzwv+nwv+nv+1;
             for(unsigned int i=0; i < this->size; i += inc) this->v[i] -= a;
@@ -881,8 +1201,8 @@ namespace Array {
         }
     };
 
-    template<class T>
-    std::ostream& operator << (std::ostream& s, const array5<T>& A)
+    template<class T, class Alloc>
+    std::ostream& operator << (std::ostream& s, const array5<T,Alloc>& A)
     {
         T *p=A;
         for(unsigned int i=0; i < A.Nx(); i++) {
@@ -904,8 +1224,8 @@ namespace Array {
         return s;
     }
 
-    template<class T>
-    std::istream& operator >> (std::istream& s, const array5<T>& A)
+    template<class T, class Alloc>
+    std::istream& operator >> (std::istream& s, const array5<T,Alloc>& A)
     {
         return A.Input(s);
     }
@@ -918,8 +1238,8 @@ namespace Array {
 #define __check(i,n,o,dim,m) this->Check(i-o,n,dim,m,o)
 #endif
 
-    template<class T>
-    class Array1 : public array1<T> {
+    template<class T, class Alloc=heap<T> >
+    class Array1 : public array1<T,Alloc> {
     protected:
         T *voff; // Offset pointer to memory block
         int ox;
@@ -927,7 +1247,7 @@ namespace Array {
         void Offsets() {
             voff=this->v-ox;
         }
-        using array1<T>::Dimension;
+        using array1<T,Alloc>::Dimension;
 
         void Dimension(unsigned int nx0, int ox0=0) {
             this->size=nx0;
@@ -939,7 +1259,7 @@ namespace Array {
             Dimension(nx0,ox0);
             this->clear(this->allocated);
         }
-        void Dimension(const Array1<T>& A) {
+        void Dimension(const Array1<T,Alloc>& A) {
             Dimension(A.size,A.v,A.ox); this->state=A.test(this->temporary);
         }
 
@@ -964,11 +1284,23 @@ namespace Array {
         Array1(T *v0, int ox0=0) {
             Dimension(INT_MAX,v0,ox0);
         }
+        Array1(const Array1<T,Alloc>&)=default;
+        Array1(Array1<T,Alloc>&& A) : array1<T,Alloc>(std::move(A)), ox(A.ox) {
+            Offsets();
+            A.ox=0; A.Offsets();
+        }
+
+        // Views and slices of the arrays with offsets are indexed as the
+        // arrays themselves, and from 0, respectively
+        Array1<T,Alloc> view() const {return Array1<T,Alloc>(this->size,this->v,ox);}
+        strided<T,1> slice(int x0, unsigned int nx0) const {
+            return array1<T,Alloc>::slice(x0-ox,nx0);
+        }
 
 #ifdef NDEBUG
         typedef T *opt;
 #else
-        typedef Array1<T> opt;
+        typedef Array1<T,Alloc> opt;
 #endif
 
         T& operator [] (int ix) const {__check(ix,this->size,ox,1,1); return voff[ix];}
@@ -976,31 +1308,38 @@ namespace Array {
         T* operator () () const {return this->v;}
         operator T* () const {return this->v;}
 
-        Array1<T> operator + (int i) const {return Array1<T>(this->size-i,this->v+i,ox);}
+        Array1<T,Alloc> operator + (int i) const {return Array1<T,Alloc>(this->size-i,this->v+i,ox);}
         void Set(T *a) {this->v=a; Offsets(); this->clear(this->allocated);}
 
-        Array1<T>& operator = (T a) {this->Load(a); return *this;}
-        Array1<T>& operator = (const T *a) {this->Load(a); return *this;}
-        Array1<T>& operator = (const Array1<T>& A) {
+        Array1<T,Alloc>& operator = (T a) {this->Load(a); return *this;}
+        Array1<T,Alloc>& operator = (const T *a) {this->Load(a); return *this;}
+        Array1<T,Alloc>& operator = (const Array1<T,Alloc>& A) {
             __checkEqual(this->size,A.Size(),1,1);
             __checkEqual(ox,A.Ox(),1,1);
             this->Load(A());
             A.Purge();
             return *this;
         }
-        Array1<T>& operator = (const array1<T>& A) {
+        Array1<T,Alloc>& operator = (const array1<T,Alloc>& A) {
             __checkEqual(this->size,A.Size(),1,1);
             __checkEqual(ox,0,1,1);
             this->Load(A());
             A.Purge();
             return *this;
         }
+        Array1<T,Alloc>& operator = (Array1<T,Alloc>&& A) {
+            if(!this->Movable(A)) return *this=static_cast<const Array1<T,Alloc>&>(A);
+            this->Take(A);
+            ox=A.ox; Offsets();
+            A.ox=0; A.Offsets();
+            return *this;
+        }
 
         int Ox() const {return ox;}
     };
 
-    template<class T>
-    class Array2 : public array2<T> {
+    template<class T, class Alloc=heap<T> >
+    class Array2 : public array2<T,Alloc> {
     protected:
         T *voff,*vtemp;
         int ox,oy;
@@ -1009,7 +1348,7 @@ namespace Array {
             vtemp=this->v-ox*(int) this->ny;
             voff=vtemp-oy;
         }
-        using array1<T>::Dimension;
+        using array1<T,Alloc>::Dimension;
 
         void Dimension(unsigned int nx0, unsigned int ny0, int ox0=0, int oy0=0) {
             this->nx=nx0; this->ny=ny0;
@@ -1039,15 +1378,30 @@ namespace Array {
         Array2(unsigned int nx0, unsigned int ny0, T *v0, int ox0=0, int oy0=0) {
             Dimension(nx0,ny0,v0,ox0,oy0);
         }
+        Array2(const Array2<T,Alloc>&)=default;
+        Array2(Array2<T,Alloc>&& A) : array2<T,Alloc>(std::move(A)), ox(A.ox), oy(A.oy) {
+            Offsets();
+            A.ox=A.oy=0; A.Offsets();
+        }
+
+        Array2<T,Alloc> view() const {
+            return Array2<T,Alloc>(this->nx,this->ny,this->v,ox,oy);
+        }
+        strided<T,2> slice(int x0, unsigned int nx0) const {
+            return array2<T,Alloc>::slice(x0-ox,nx0);
+        }
+        strided<T,2> slice(int x0, unsigned int nx0, int y0, unsigned int ny0) const {
+            return array2<T,Alloc>::slice(x0-ox,nx0,y0-oy,ny0);
+        }
 
 #ifndef __NOARRAY2OPT
         T *operator [] (int ix) const {
     return voff+ix*(int) this->ny;
   }
 #else
-        Array1<T> operator [] (int ix) const {
+        Array1<T,Alloc> operator [] (int ix) const {
             __check(ix,this->nx,ox,2,1);
-            return Array1<T>(this->ny,vtemp+ix*(int) this->ny,oy);
+            return Array1<T,Alloc>(this->ny,vtemp+ix*(int) this->ny,oy);
         }
 #endif
 
@@ -1063,9 +1417,9 @@ namespace Array {
         T* operator () () const {return this->v;}
         void Set(T *a) {this->v=a; Offsets(); this->clear(this->allocated);}
 
-        Array2<T>& operator = (T a) {this->Load(a); return *this;}
-        Array2<T>& operator = (T *a) {this->Load(a); return *this;}
-        Array2<T>& operator = (const Array2<T>& A) {
+        Array2<T,Alloc>& operator = (T a) {this->Load(a); return *this;}
+        Array2<T,Alloc>& operator = (T *a) {this->Load(a); return *this;}
+        Array2<T,Alloc>& operator = (const Array2<T,Alloc>& A) {
             __checkEqual(this->nx,A.Nx(),2,1);
             __checkEqual(this->ny,A.Ny(),2,2);
             __checkEqual(ox,A.Ox(),2,1);
@@ -1074,7 +1428,7 @@ namespace Array {
             A.Purge();
             return *this;
         }
-        Array2<T>& operator = (const array2<T>& A) {
+        Array2<T,Alloc>& operator = (const array2<T,Alloc>& A) {
             __checkEqual(this->nx,A.Nx(),2,1);
             __checkEqual(this->ny,A.Ny(),2,2);
             __checkEqual(ox,0,2,1);
@@ -1083,14 +1437,23 @@ namespace Array {
             A.Purge();
             return *this;
         }
+        Array2<T,Alloc>& operator = (Array2<T,Alloc>&& A) {
+            if(!this->Movable(A)) return *this=static_cast<const Array2<T,Alloc>&>(A);
+            this->Take(A);
+            this->nx=A.nx; this->ny=A.ny;
+            ox=A.ox; oy=A.oy; Offsets();
+            A.nx=A.ny=0;
+            A.ox=A.oy=0; A.Offsets();
+            return *this;
+        }
 
         int Ox() const {return ox;}
         int Oy() const {return oy;}
 
     };
 
-    template<class T>
-    class Array3 : public array3<T> {
+    template<class T, class Alloc=heap<T> >
+    class Array3 : public array3<T,Alloc> {
     protected:
         T *voff,*vtemp;
         int ox,oy,oz;
@@ -1099,7 +1462,7 @@ namespace Array {
             vtemp=this->v-ox*(int) this->nyz;
             voff=vtemp-oy*(int) this->nz-oz;
         }
-        using array1<T>::Dimension;
+        using array1<T,Alloc>::Dimension;
 
         void Dimension(unsigned int nx0, unsigned int ny0, unsigned int nz0,
                        int ox0=0, int oy0=0, int oz0=0) {
@@ -1131,10 +1494,26 @@ namespace Array {
                int ox0=0, int oy0=0, int oz0=0) {
             Dimension(nx0,ny0,nz0,v0,ox0,oy0,oz0);
         }
+        Array3(const Array3<T,Alloc>&)=default;
+        Array3(Array3<T,Alloc>&& A) : array3<T,Alloc>(std::move(A)), ox(A.ox), oy(A.oy),
+                                oz(A.oz) {
+            Offsets();
+            A.ox=A.oy=A.oz=0; A.Offsets();
+        }
+
+        Array3<T,Alloc> view() const {
+            return Array3<T,Alloc>(this->nx,this->ny,this->nz,this->v,ox,oy,oz);
+        }
+        strided<T,3> slice(int x0, unsigned int nx0) const {
+            return array3<T,Alloc>::slice(x0-ox,nx0);
+        }
+        strided<T,3> slice(int x0, unsigned int nx0, int y0, unsigned int ny0) const {
+            return array3<T,Alloc>::slice(x0-ox,nx0,y0-oy,ny0);
+        }
 
-        Array2<T> operator [] (int ix) const {
+        Array2<T,Alloc> operator [] (int ix) const {
             __check(ix,this->nx,ox,3,1);
-            return Array2<T>(this->ny,this->nz,vtemp+ix*(int) this->nyz,oy,oz);
+            return Array2<T,Alloc>(this->ny,this->nz,vtemp+ix*(int) this->nyz,oy,oz);
         }
         T& operator () (int ix, int iy, int iz) const {
             __check(ix,this->nx,ox,3,1);
@@ -1149,9 +1528,9 @@ namespace Array {
         T* operator () () const {return this->v;}
         void Set(T *a) {this->v=a; Offsets(); this->clear(this->allocated);}
 
-        Array3<T>& operator = (T a) {this->Load(a); return *this;}
-        Array3<T>& operator = (T *a) {this->Load(a); return *this;}
-        Array3<T>& operator = (const Array3<T>& A) {
+        Array3<T,Alloc>& operator = (T a) {this->Load(a); return *this;}
+        Array3<T,Alloc>& operator = (T *a) {this->Load(a); return *this;}
+        Array3<T,Alloc>& operator = (const Array3<T,Alloc>& A) {
             __checkEqual(this->nx,A.Nx(),3,1);
             __checkEqual(this->ny,A.Ny(),3,2);
             __checkEqual(this->nz,A.Nz(),3,3);
@@ -1162,7 +1541,7 @@ namespace Array {
             A.Purge();
             return *this;
         }
-        Array3<T>& operator = (const array3<T>& A) {
+        Array3<T,Alloc>& operator = (const array3<T,Alloc>& A) {
             __checkEqual(this->nx,A.Nx(),3,1);
             __checkEqual(this->ny,A.Ny(),3,2);
             __checkEqual(this->nz,A.Nz(),3,3);
@@ -1173,6 +1552,15 @@ namespace Array {
             A.Purge();
             return *this;
         }
+        Array3<T,Alloc>& operator = (Array3<T,Alloc>&& A) {
+            if(!this->Movable(A)) return *this=static_cast<const Array3<T,Alloc>&>(A);
+            this->Take(A);
+            this->nx=A.nx; this->ny=A.ny; this->nz=A.nz; this->nyz=A.nyz;
+            ox=A.ox; oy=A.oy; oz=A.oz; Offsets();
+            A.nx=A.ny=A.nz=A.nyz=0;
+            A.ox=A.oy=A.oz=0; A.Offsets();
+            return *this;
+        }
 
         int Ox() const {return ox;}
         int Oy() const {return oy;}
@@ -1180,8 +1568,8 @@ namespace Array {
 
     };
 
-    template<class T>
-    class Array4 : public array4<T> {
+    template<class T, class Alloc=heap<T> >
+    class Array4 : public array4<T,Alloc> {
     protected:
         T *voff,*vtemp;
         int ox,oy,oz,ow;
@@ -1190,7 +1578,7 @@ namespace Array {
             vtemp=this->v-ox*(int) this->nyzw;
             voff=vtemp-oy*(int) this->nzw-oz*(int) this->nw-ow;
         }
-        using array1<T>::Dimension;
+        using array1<T,Alloc>::Dimension;
 
         void Dimension(unsigned int nx0, unsigned int ny0, unsigned int nz0,
                        unsigned int nw0,
@@ -1228,10 +1616,27 @@ namespace Array {
                int ox0=0, int oy0=0, int oz0=0, int ow0=0) {
             Dimension(nx0,ny0,nz0,nw0,v0,ox0,oy0,oz0,ow0);
         }
+        Array4(const Array4<T,Alloc>&)=default;
+        Array4(Array4<T,Alloc>&& A) : array4<T,Alloc>(std::move(A)), ox(A.ox), oy(A.oy),
+                                oz(A.oz), ow(A.ow) {
+            Offsets();
+            A.ox=A.oy=A.oz=A.ow=0; A.Offsets();
+        }
 
-        Array3<T> operator [] (int ix) const {
+        Array4<T,Alloc> view() const {
+            return Array4<T,Alloc>(this->nx,this->ny,this->nz,this->nw,this->v,
+                             ox,oy,oz,ow);
+        }
+        strided<T,4> slice(int x0, unsigned int nx0) const {
+            return array4<T,Alloc>::slice(x0-ox,nx0);
+        }
+        strided<T,4> slice(int x0, unsigned int nx0, int y0, unsigned int ny0) const {
+            return array4<T,Alloc>::slice(x0-ox,nx0,y0-oy,ny0);
+        }
+
+        Array3<T,Alloc> operator [] (int ix) const {
             __check(ix,this->nx,ox,3,1);
-            return Array3<T>(this->ny,this->nz,this->nw,vtemp+ix*(int) this->nyzw,
+            return Array3<T,Alloc>(this->ny,this->nz,this->nw,vtemp+ix*(int) this->nyzw,
                              oy,oz,ow);
         }
         T& operator () (int ix, int iy, int iz, int iw) const {
@@ -1248,10 +1653,10 @@ namespace Array {
         T* operator () () const {return this->v;}
         void Set(T *a) {this->v=a; Offsets(); this->clear(this->allocated);}
 
-        Array4<T>& operator = (T a) {this->Load(a); return *this;}
-        Array4<T>& operator = (T *a) {this->Load(a); return *this;}
+        Array4<T,Alloc>& operator = (T a) {this->Load(a); return *this;}
+        Array4<T,Alloc>& operator = (T *a) {this->Load(a); return *this;}
 
-        Array4<T>& operator = (const Array4<T>& A) {
+        Array4<T,Alloc>& operator = (const Array4<T,Alloc>& A) {
             __checkEqual(this->nx,A.Nx(),4,1);
             __checkEqual(this->ny,A.Ny(),4,2);
             __checkEqual(this->nz,A.Nz(),4,3);
@@ -1264,7 +1669,7 @@ namespace Array {
             A.Purge();
             return *this;
         }
-        Array4<T>& operator = (const array4<T>& A) {
+        Array4<T,Alloc>& operator = (const array4<T,Alloc>& A) {
             __checkEqual(this->nx,A.Nx(),4,1);
             __checkEqual(this->ny,A.Ny(),4,2);
             __checkEqual(this->nz,A.Nz(),4,3);
@@ -1281,6 +1686,16 @@ namespace Array {
             A.Purge();
             return *this;
         }
+        Array4<T,Alloc>& operator = (Array4<T,Alloc>&& A) {
+            if(!this->Movable(A)) return *this=static_cast<const Array4<T,Alloc>&>(A);
+            this->Take(A);
+            this->nx=A.nx; this->ny=A.ny; this->nz=A.nz; this->nw=A.nw;
+            this->nyz=A.nyz; this->nzw=A.nzw; this->nyzw=A.nyzw;
+            ox=A.ox; oy=A.oy; oz=A.oz; ow=A.ow; Offsets();
+            A.nx=A.ny=A.nz=A.nw=A.nyz=A.nzw=A.nyzw=0;
+            A.ox=A.oy=A.oz=A.ow=0; A.Offsets();
+            return *this;
+        }
 
         int Ox() const {return ox;}
         int Oy() const {return oy;}
@@ -1288,8 +1703,8 @@ namespace Array {
         int O4() const {return ow;}
     };
 
-    template<class T>
-    class Array5 : public array5<T> {
+    template<class T, class Alloc=heap<T> >
+    class Array5 : public array5<T,Alloc> {
     protected:
         T *voff,*vtemp;
         int ox,oy,oz,ow,ov;
@@ -1298,7 +1713,7 @@ namespace Array {
             vtemp=this->v-ox*(int) this->nyzwv;
             voff=vtemp-oy*(int) this->nzwv-oz*(int) this->nwv-ow*(int) this->nv-ov;
         }
-        using array1<T>::Dimension;
+        using array1<T,Alloc>::Dimension;
 
         void Dimension(unsigned int nx0, unsigned int ny0, unsigned int nz0,
                        unsigned int nw0,  unsigned int nv0,
@@ -1339,9 +1754,9 @@ namespace Array {
             Dimension(nx0,ny0,nz0,nw0,nv0,v0,ox0,oy0,oz0,ow0,ov0);
         }
 
-        Array4<T> operator [] (int ix) const {
+        Array4<T,Alloc> operator [] (int ix) const {
             __check(ix,this->nx,ox,4,1);
-            return Array4<T>(this->ny,this->nz,this->nw,this->nv,
+            return Array4<T,Alloc>(this->ny,this->nz,this->nw,this->nv,
                              vtemp+ix*(int) this->nyzwv,oy,oz,ow,ov);
         }
         T& operator () (int ix, int iy, int iz, int iw, int iv) const {
@@ -1360,10 +1775,10 @@ namespace Array {
         T* operator () () const {return this->v;}
         void Set(T *a) {this->v=a; Offsets(); this->clear(this->allocated);}
 
-        Array5<T>& operator = (T a) {this->Load(a); return *this;}
-        Array5<T>& operator = (T *a) {this->Load(a); return *this;}
+        Array5<T,Alloc>& operator = (T a) {this->Load(a); return *this;}
+        Array5<T,Alloc>& operator = (T *a) {this->Load(a); return *this;}
 
-        Array5<T>& operator = (const Array5<T>& A) {
+        Array5<T,Alloc>& operator = (const Array5<T,Alloc>& A) {
             __checkEqual(this->nx,A.Nx(),5,1);
             __checkEqual(this->ny,A.Ny(),5,2);
             __checkEqual(this->nz,A.Nz(),5,3);
@@ -1378,7 +1793,7 @@ namespace Array {
             A.Purge();
             return *this;
         }
-        Array5<T>& operator = (const array5<T>& A) {
+        Array5<T,Alloc>& operator = (const array5<T,Alloc>& A) {
             __checkEqual(this->nx,A.Nx(),5,1);
             __checkEqual(this->ny,A.Ny(),5,2);
             __checkEqual(this->nz,A.Nz(),5,3);
@@ -1400,8 +1815,8 @@ namespace Array {
         int O5() const {return ov;}
     };
 
-    template<class T>
-    inline bool Active(array1<T>& A)
+    template<class T, class Alloc>
+    inline bool Active(array1<T,Alloc>& A)
     {
         return A.Size();
     }
@@ -1418,26 +1833,26 @@ namespace Array {
         A=v;
     }
 
-    template<class T>
-    inline void Set(array1<T>& A, T *v)
+    template<class T, class Alloc>
+    inline void Set(array1<T,Alloc>& A, T *v)
     {
         A.Set(v);
     }
 
-    template<class T>
-    inline void Set(array1<T>& A, const array1<T>& B)
+    template<class T, class Alloc>
+    inline void Set(array1<T,Alloc>& A, const array1<T,Alloc>& B)
     {
         A.Set(B());
     }
 
-    template<class T>
-    inline void Set(Array1<T>& A, T *v)
+    template<class T, class Alloc>
+    inline void Set(Array1<T,Alloc>& A, T *v)
     {
         A.Set(v);
     }
 
-    template<class T>
-    inline void Set(Array1<T>& A, const array1<T>& B)
+    template<class T, class Alloc>
+    inline void Set(Array1<T,Alloc>& A, const array1<T,Alloc>& B)
     {
         A.Set(B());
     }
@@ -1448,8 +1863,8 @@ namespace Array {
         A=NULL;
     }
 
-    template<class T>
-    inline void Null(array1<T>& A)
+    template<class T, class Alloc>
+    inline void Null(array1<T,Alloc>& A)
     {
         A.Dimension(0);
     }
@@ -1459,8 +1874,8 @@ namespace Array {
     {
     }
 
-    template<class T>
-    inline void Dimension(array1<T> &A, unsigned int n)
+    template<class T, class Alloc>
+    inline void Dimension(array1<T,Alloc> &A, unsigned int n)
     {
         A.Dimension(n);
     }
@@ -1471,14 +1886,14 @@ namespace Array {
         A=v;
     }
 
-    template<class T>
-    inline void Dimension(array1<T>& A, unsigned int n, T *v)
+    template<class T, class Alloc>
+    inline void Dimension(array1<T,Alloc>& A, unsigned int n, T *v)
     {
         A.Dimension(n,v);
     }
 
-    template<class T>
-    inline void Dimension(Array1<T>& A, unsigned int n, T *v)
+    template<class T, class Alloc>
+    inline void Dimension(Array1<T,Alloc>& A, unsigned int n, T *v)
     {
         A.Dimension(n,v,0);
     }
@@ -1489,38 +1904,38 @@ namespace Array {
         A=v;
     }
 
-    template<class T>
-    inline void Dimension(array1<T>& A, const array1<T>& B)
+    template<class T, class Alloc>
+    inline void Dimension(array1<T,Alloc>& A, const array1<T,Alloc>& B)
     {
         A.Dimension(B);
     }
 
-    template<class T>
-    inline void Dimension(Array1<T>& A, const Array1<T>& B)
+    template<class T, class Alloc>
+    inline void Dimension(Array1<T,Alloc>& A, const Array1<T,Alloc>& B)
     {
         A.Dimension(B);
     }
 
-    template<class T>
-    inline void Dimension(Array1<T>& A, const array1<T>& B)
+    template<class T, class Alloc>
+    inline void Dimension(Array1<T,Alloc>& A, const array1<T,Alloc>& B)
     {
         A.Dimension(B);
     }
 
-    template<class T>
-    inline void Dimension(array1<T>& A, unsigned int n, const array1<T>& B)
+    template<class T, class Alloc>
+    inline void Dimension(array1<T,Alloc>& A, unsigned int n, const array1<T,Alloc>& B)
     {
         A.Dimension(n,B);
     }
 
-    template<class T>
-    inline void Dimension(Array1<T>& A, unsigned int n, const array1<T>& B, int o)
+    template<class T, class Alloc>
+    inline void Dimension(Array1<T,Alloc>& A, unsigned int n, const array1<T,Alloc>& B, int o)
     {
         A.Dimension(n,B,o);
     }
 
-    template<class T>
-    inline void Dimension(Array1<T>& A, unsigned int n, T *v, int o)
+    template<class T, class Alloc>
+    inline void Dimension(Array1<T,Alloc>& A, unsigned int n, T *v, int o)
     {
         A.Dimension(n,v,o);
     }
@@ -1538,14 +1953,14 @@ namespace Array {
         else A=new T[n];
     }
 
-    template<class T>
-    inline void Allocate(array1<T>& A, unsigned int n, size_t align=0)
+    template<class T, class Alloc>
+    inline void Allocate(array1<T,Alloc>& A, unsigned int n, size_t align=0)
     {
         A.Allocate(n,align);
     }
 
-    template<class T>
-    inline void Allocate(Array1<T>& A, unsigned int n, size_t align=0)
+    template<class T, class Alloc>
+    inline void Allocate(Array1<T,Alloc>& A, unsigned int n, size_t align=0)
     {
         A.Allocate(n,align);
     }
@@ -1557,8 +1972,8 @@ namespace Array {
         A -= o;
     }
 
-    template<class T>
-    inline void Allocate(Array1<T>& A, unsigned int n, int o, size_t align=0)
+    template<class T, class Alloc>
+    inline void Allocate(Array1<T,Alloc>& A, unsigned int n, int o, size_t align=0)
     {
         A.Allocate(n,o,align);
     }
@@ -1569,14 +1984,14 @@ namespace Array {
         if(A) delete [] A;
     }
 
-    template<class T>
-    inline void Deallocate(array1<T>& A)
+    template<class T, class Alloc>
+    inline void Deallocate(array1<T,Alloc>& A)
     {
         A.Deallocate();
     }
 
-    template<class T>
-    inline void Deallocate(Array1<T>& A)
+    template<class T, class Alloc>
+    inline void Deallocate(Array1<T,Alloc>& A)
     {
         A.Deallocate();
     }
@@ -1587,8 +2002,8 @@ namespace Array {
         if(A) delete [] (A+o);
     }
 
-    template<class T>
-    inline void Deallocate(Array1<T>& A, int)
+    template<class T, class Alloc>
+    inline void Deallocate(Array1<T,Alloc>& A, int)
     {
         A.Deallocate();
     }
@@ -1600,14 +2015,14 @@ namespace Array {
         Allocate(A,n,align);
     }
 
-    template<class T>
-    inline void Reallocate(array1<T>& A, unsigned int n)
+    template<class T, class Alloc>
+    inline void Reallocate(array1<T,Alloc>& A, unsigned int n)
     {
         A.Reallocate(n);
     }
 
-    template<class T>
-    inline void Reallocate(Array1<T>& A, unsigned int n)
+    template<class T, class Alloc>
+    inline void Reallocate(Array1<T,Alloc>& A, unsigned int n)
     {
         A.Reallocate(n);
     }
@@ -1620,8 +2035,8 @@ namespace Array {
         A -= o;
     }
 
-    template<class T>
-    inline void Reallocate(Array1<T>& A, unsigned int n, int o, size_t align=0)
+    template<class T, class Alloc>
+    inline void Reallocate(Array1<T,Alloc>& A, unsigned int n, int o, size_t align=0)
     {
         A.Reallocate(n,o,align);
     }
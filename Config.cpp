@@ -24,7 +24,13 @@ Config::Config(string &fileName): configFile(fileName) {
 
 Config::~Config() {}
 
-void Config::setDefault() {}
+void Config::setDefault() {
+    ingestMode = "sparse";
+    ingestThreads = 0;
+    seriesStore = "";
+    batchSize = 256;
+    runtime = config_runtime();
+}
 
 string &Config::ConfigFile() {
     return configFile;
@@ -62,10 +68,46 @@ void Config::NcOutputRoot(string value) {
     ncOutputRoot=value;
 }
 
+string Config::IngestMode() const {
+    return ingestMode;
+}
+
+void Config::IngestMode(string value) {
+    ingestMode=value;
+}
+
+int Config::IngestThreads() const {
+    return ingestThreads;
+}
+
+void Config::IngestThreads(int value) {
+    ingestThreads=value;
+}
+
+string Config::SeriesStore() const {
+    return seriesStore;
+}
+
+void Config::SeriesStore(string value) {
+    seriesStore=value;
+}
+
 vector<struct config_model> &Config::Models() {
     return models;
 }
 
+int Config::BatchSize() const {
+    return batchSize;
+}
+
+void Config::BatchSize(int value) {
+    batchSize=value;
+}
+
+config_runtime &Config::Runtime() {
+    return runtime;
+}
+
 string Config::AreasFile() const {
     return areasFile;
 }
@@ -101,14 +143,20 @@ void Config::loadFromJson(const string &fileName) {
             }
         }
         if (io.contains("nc_output_root")) { ncOutputRoot = io["nc_output_root"]; }
+        if (io.contains("ingest")) { ingestMode = io["ingest"]; }
+        if (io.contains("ingest_threads")) { ingestThreads = io["ingest_threads"]; }
+        if (io.contains("series_store")) { seriesStore = io["series_store"]; }
     }
 
     if (config.contains("inference")) {
         json inference=config["inference"];
         if (inference.contains("base_path")) { modelsBasePath = inference["base_path"]; }
+        if (inference.contains("batch_size")) { batchSize = inference["batch_size"]; }
+        if (inference.contains("runtime")) { loadRuntime(inference["runtime"], runtime); }
         if (inference.contains("models") && inference["models"].is_array()) {
             for (auto model:inference["models"]) {
                 config_model m;
+                m.runtime = runtime;
                 if (model.contains("name")) {
                     m.name = modelsBasePath + "/" + model["name"].get<std::string>();
                 }
@@ -131,8 +179,31 @@ void Config::loadFromJson(const string &fileName) {
                         m.output_shape.push_back(dim.get<int64_t>());
                     }
                 }
+                if (model.contains("runtime")) {
+                    json &modelRuntime = model["runtime"];
+                    if (modelRuntime.contains("intra_op_threads") || modelRuntime.contains("inter_op_threads")) {
+                        m.runtime.shared_threads = false;
+                    }
+                    loadRuntime(modelRuntime, m.runtime);
+                }
                 models.push_back(m);
             }
         }
     }
+}
+
+void Config::loadRuntime(json &section, config_runtime &settings) {
+    if (section.contains("workers")) { settings.workers = section["workers"]; }
+    if (section.contains("intra_op_threads")) { settings.intra_op_threads = section["intra_op_threads"]; }
+    if (section.contains("inter_op_threads")) { settings.inter_op_threads = section["inter_op_threads"]; }
+    if (section.contains("shared_threads")) { settings.shared_threads = section["shared_threads"]; }
+    if (section.contains("spinning")) { settings.spinning = section["spinning"]; }
+    if (section.contains("graph_optimization")) { settings.graph_optimization = section["graph_optimization"]; }
+    if (section.contains("execution_mode")) { settings.execution_mode = section["execution_mode"]; }
+    if (section.contains("mem_pattern")) { settings.mem_pattern = section["mem_pattern"]; }
+    if (section.contains("cpu_arena")) { settings.cpu_arena = section["cpu_arena"]; }
+    if (section.contains("arena_extend_strategy")) { settings.arena_extend_strategy = section["arena_extend_strategy"]; }
+    if (section.contains("arena_max_mem")) { settings.arena_max_mem = section["arena_max_mem"]; }
+    if (section.contains("execution_provider")) { settings.execution_provider = section["execution_provider"]; }
+    if (section.contains("model_cache")) { settings.model_cache = section["model_cache"]; }
 }
\ No newline at end of file
@@ -17,6 +17,32 @@ using namespace std;
 
 #include <nlohmann/json.hpp>
 
+// The ONNX Runtime settings, from the "runtime" section of "inference". The "runtime" section of a model
+// overrides them for its session: setting its threads gives it thread pools of its own.
+struct config_runtime {
+    // The OpenMP threads running the models, 0 for all the threads of the rank
+    int workers = 0;
+    // The threads of a run, 0 to share out the threads of the rank the workers leave free
+    int intra_op_threads = 0;
+    int inter_op_threads = 1;
+    // Whether the sessions run on the thread pools of the environment rather than on pools of their own
+    bool shared_threads = true;
+    bool spinning = true;
+    // disable, basic, extended or all
+    std::string graph_optimization = "extended";
+    // sequential or parallel
+    std::string execution_mode = "sequential";
+    bool mem_pattern = true;
+    bool cpu_arena = true;
+    // The arena shared by the sessions: next_power_of_two or same_as_requested, and its limit, 0 for none
+    std::string arena_extend_strategy = "next_power_of_two";
+    size_t arena_max_mem = 0;
+    // cuda, to run on the GPU of the thread if there is one, or cpu
+    std::string execution_provider = "cuda";
+    // Whether the models run on the CPU are loaded from their optimized graph, saved next to them at the first run
+    bool model_cache = true;
+};
+
 struct config_model {
     std::string name;
     std::string input;
@@ -24,6 +50,7 @@ struct config_model {
     std::string output_type;
     std::vector<int64_t> input_shape;
     std::vector<int64_t> output_shape;
+    config_runtime runtime;
 };
 
 class Config {
@@ -44,8 +71,17 @@ public:
     vector<string> &NcInputs();
     string NcOutputRoot() const;
     void NcOutputRoot(string value);
+    string IngestMode() const;
+    void IngestMode(string value);
+    int IngestThreads() const;
+    void IngestThreads(int value);
+    string SeriesStore() const;
+    void SeriesStore(string value);
 
     vector<struct config_model> &Models();
+    int BatchSize() const;
+    void BatchSize(int value);
+    config_runtime &Runtime();
 
     string AreasFile() const;
     void AreasFile(string value);
@@ -63,15 +99,21 @@ private:
     string ncBasePath;
     vector<string> ncInputs;
     string ncOutputRoot;
+    string ingestMode;
+    int ingestThreads;
+    string seriesStore;
 
     string modelsBasePath;
     vector<struct config_model> models;
+    int batchSize;
+    config_runtime runtime;
 
     string areasFile;
 
     config_model _data;
 
     void setDefault();
+    void loadRuntime(nlohmann::json &section, config_runtime &settings);
 };
 
 #endif //AIQUAMPLUSPLUS_CONFIG_HPP
\ No newline at end of file
@@ -0,0 +1,151 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#include "GridIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+GridAxis::GridAxis(const double *coords, size_t n): coords(coords), n(n) {
+    if (n == 0) {
+        return;
+    }
+
+    ascending = n < 2 || coords[1] > coords[0];
+    monotonic = true;
+    for (size_t k = 1; k < n && monotonic; k++) {
+        monotonic = ascending ? coords[k] > coords[k - 1] : coords[k] < coords[k - 1];
+    }
+
+    // Evenly spaced if no coordinate is off its affine position by more than a small fraction of the step,
+    // so that the closed form lands on the nearest index or next to it
+    if (monotonic && n > 1) {
+        step = (coords[n - 1] - coords[0]) / (n - 1);
+        affine = true;
+        for (size_t k = 1; k < n && affine; k++) {
+            affine = std::abs(coords[k] - (coords[0] + k * step)) <= 1e-3 * std::abs(step);
+        }
+    }
+}
+
+bool GridAxis::Monotonic() const { return monotonic; }
+bool GridAxis::Affine() const { return affine; }
+
+size_t GridAxis::nearest(double x) const {
+    if (n == 0 || std::isnan(x)) {
+        return 0;
+    }
+
+    size_t k;
+    if (affine) {
+        double f = (x - coords[0]) / step;
+        k = f <= 0 ? 0 : f >= n - 1 ? n - 1 : (size_t)std::lround(f);
+    } else if (ascending) {
+        k = std::lower_bound(coords, coords + n, x) - coords;
+    } else {
+        k = std::lower_bound(coords, coords + n, x, std::greater<double>()) - coords;
+    }
+    k = std::min(k, n - 1);
+
+    // Settle on the nearest coordinate
+    while (k > 0 && std::abs(x - coords[k - 1]) < std::abs(x - coords[k])) {
+        k--;
+    }
+    while (k + 1 < n && std::abs(x - coords[k + 1]) < std::abs(x - coords[k])) {
+        k++;
+    }
+    return k;
+}
+
+GridIndex::GridIndex(const double *lat, size_t dimLat, const double *lon, size_t dimLon): latAxis(lat, dimLat), lonAxis(lon, dimLon) {
+}
+
+GridIndex::GridIndex(const double *lat, const double *lon, size_t dimLat, size_t dimLon):
+    latAxis(nullptr, 0), lonAxis(nullptr, 0), lat2D(lat), lon2D(lon), dimLat(dimLat), dimLon(dimLon) {
+}
+
+// On a grid of monotonic latitudes and longitudes the nearest point, in the (lat,lon) plane, is made
+// of the nearest latitude and the nearest longitude
+bool GridIndex::Rectilinear() const {
+    return latAxis.Monotonic() && lonAxis.Monotonic();
+}
+
+bool GridIndex::Curvilinear() const {
+    return lat2D != nullptr;
+}
+
+void GridIndex::nearest(double lat, double lon, size_t &j, size_t &i) const {
+    j = latAxis.nearest(lat);
+    i = lonAxis.nearest(lon);
+}
+
+// Inverts the bilinear map of the cell with the corner (cellJ,cellI), the point being at s along j and at t along i.
+// Newton converges in a few steps on the convex cells of an ocean grid.
+void GridIndex::inverse(size_t cellJ, size_t cellI, double lat, double lon, double &s, double &t) const {
+    size_t p00 = cellJ * dimLon + cellI, p10 = p00 + dimLon, p01 = p00 + 1, p11 = p10 + 1;
+    double aLat = lat2D[p10] - lat2D[p00], aLon = lon2D[p10] - lon2D[p00];
+    double bLat = lat2D[p01] - lat2D[p00], bLon = lon2D[p01] - lon2D[p00];
+    double cLat = lat2D[p11] - lat2D[p10] - lat2D[p01] + lat2D[p00];
+    double cLon = lon2D[p11] - lon2D[p10] - lon2D[p01] + lon2D[p00];
+
+    s = 0.5;
+    t = 0.5;
+    for (int iteration = 0; iteration < 8; iteration++) {
+        double rLat = lat2D[p00] + s * aLat + t * bLat + s * t * cLat - lat;
+        double rLon = lon2D[p00] + s * aLon + t * bLon + s * t * cLon - lon;
+        double dsLat = aLat + t * cLat, dsLon = aLon + t * cLon;
+        double dtLat = bLat + s * cLat, dtLon = bLon + s * cLon;
+        double det = dsLat * dtLon - dtLat * dsLon;
+        if (det == 0) {
+            break;
+        }
+        double ds = (rLat * dtLon - dtLat * rLon) / det;
+        double dt = (dsLat * rLon - rLat * dsLon) / det;
+        s -= ds;
+        t -= dt;
+        if (std::abs(ds) < 1e-12 && std::abs(dt) < 1e-12) {
+            break;
+        }
+    }
+}
+
+// Walks from the cell (cellJ,cellI) towards the point, a cell at a time, until the cell holding it. A point
+// off the grid is clamped on its border. Returns false, the cell being the last one visited, after maxSteps cells.
+bool GridIndex::walk(double lat, double lon, size_t &cellJ, size_t &cellI, double &j, double &i, int maxSteps) const {
+    const double eps = 1e-9;
+    if (dimLat < 2 || dimLon < 2) {
+        return false;
+    }
+
+    cellJ = std::min(cellJ, dimLat - 2);
+    cellI = std::min(cellI, dimLon - 2);
+    for (int step = 0; step < maxSteps; step++) {
+        double s, t;
+        inverse(cellJ, cellI, lat, lon, s, t);
+        if (std::isnan(s) || std::isnan(t)) {
+            return false;
+        }
+
+        int dj = s < -eps ? -1 : s > 1 + eps ? 1 : 0;
+        int di = t < -eps ? -1 : t > 1 + eps ? 1 : 0;
+        if ((dj < 0 && cellJ == 0) || (dj > 0 && cellJ == dimLat - 2)) {
+            dj = 0;
+            s = std::min(std::max(s, 0.0), 1.0);
+        }
+        if ((di < 0 && cellI == 0) || (di > 0 && cellI == dimLon - 2)) {
+            di = 0;
+            t = std::min(std::max(t, 0.0), 1.0);
+        }
+
+        if (dj == 0 && di == 0) {
+            j = cellJ + s;
+            i = cellI + t;
+            return true;
+        }
+        cellJ += dj;
+        cellI += di;
+    }
+    return false;
+}
@@ -0,0 +1,63 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#ifndef AIQUAMPLUSPLUS_GRIDINDEX_HPP
+#define AIQUAMPLUSPLUS_GRIDINDEX_HPP
+
+#include <cstddef>
+
+// Nearest index lookup on a 1D coordinate: in closed form when it is evenly spaced,
+// by binary search when it is monotonic. The coordinates are not copied.
+class GridAxis {
+public:
+    GridAxis(const double *coords, size_t n);
+
+    bool Monotonic() const;
+    bool Affine() const;
+
+    size_t nearest(double x) const;
+
+private:
+    const double *coords;
+    size_t n;
+    bool ascending = true;
+    bool monotonic = false;
+    bool affine = false;
+    double step = 0.0;
+};
+
+// The cell a point was last located in, where the search for the next point starts
+struct cell_hint {
+    size_t j = 0;
+    size_t i = 0;
+    bool valid = false;
+};
+
+// Lookup of the nearest (j,i) on a grid made of 1D latitudes and longitudes, or location of the fractional
+// (j,i) of a point on a curvilinear grid, made of 2D latitudes and longitudes of dimLat x dimLon values
+class GridIndex {
+public:
+    GridIndex(const double *lat, size_t dimLat, const double *lon, size_t dimLon);
+    GridIndex(const double *lat, const double *lon, size_t dimLat, size_t dimLon);
+
+    bool Rectilinear() const;
+    bool Curvilinear() const;
+
+    void nearest(double lat, double lon, size_t &j, size_t &i) const;
+
+    bool walk(double lat, double lon, size_t &cellJ, size_t &cellI, double &j, double &i, int maxSteps) const;
+
+private:
+    GridAxis latAxis;
+    GridAxis lonAxis;
+
+    const double *lat2D = nullptr;
+    const double *lon2D = nullptr;
+    size_t dimLat = 0;
+    size_t dimLon = 0;
+
+    void inverse(size_t cellJ, size_t cellI, double lat, double lon, double &s, double &t) const;
+};
+
+#endif //AIQUAMPLUSPLUS_GRIDINDEX_HPP
@@ -0,0 +1,39 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#ifndef AIQUAMPLUSPLUS_HASH_HPP
+#define AIQUAMPLUSPLUS_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 64-bit FNV-1a, chained through the hash argument
+inline uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t idx = 0; idx < size; idx++) {
+        hash ^= bytes[idx];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Chains the hash of the content of a file to the given one
+inline bool hashFile(const std::string &fileName, uint64_t &hash) {
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hash = fnv1a(buffer.data(), file.gcount(), hash);
+    }
+    return true;
+}
+
+#endif //AIQUAMPLUSPLUS_HASH_HPP
@@ -0,0 +1,133 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#include "MaskPyramid.hpp"
+
+#include <algorithm>
+
+// No state yet, when merging the states of a region
+static const int NONE = -1;
+
+MaskPyramid::MaskPyramid(const double *mask, size_t rows, size_t columns): rows(rows), columns(columns) {
+    words = (rows + 63) / 64;
+    bits.assign(columns * words, 0);
+    for (size_t j = 0; j < rows; j++) {
+        for (size_t i = 0; i < columns; i++) {
+            if (mask[j * columns + i] == 1) {
+                bits[i * words + j / 64] |= uint64_t(1) << (j % 64);
+            }
+        }
+    }
+
+    // The first level out of the bits, the padding rows of the last word excluded
+    level first{words, (columns + blockSize - 1) / blockSize, {}};
+    first.states.resize(first.rows * first.columns);
+    for (size_t bj = 0; bj < first.rows; bj++) {
+        uint64_t valid = rowBits(bj, 0, rows - 1);
+        for (size_t bi = 0; bi < first.columns; bi++) {
+            int s = NONE;
+            for (size_t i = bi * blockSize; i < std::min((bi + 1) * blockSize, columns) && s != MIXED; i++) {
+                uint64_t word = bits[i * words + bj];
+                s = merge(s, word == 0 ? LAND : word == valid ? SEA : MIXED);
+            }
+            first.states[bj * first.columns + bi] = s;
+        }
+    }
+    levels.push_back(std::move(first));
+
+    while (levels.back().rows > 1 || levels.back().columns > 1) {
+        const level &below = levels.back();
+        level next{(below.rows + 1) / 2, (below.columns + 1) / 2, {}};
+        next.states.resize(next.rows * next.columns);
+        for (size_t bj = 0; bj < next.rows; bj++) {
+            for (size_t bi = 0; bi < next.columns; bi++) {
+                int s = NONE;
+                for (size_t cj = 2 * bj; cj < std::min(2 * bj + 2, below.rows); cj++) {
+                    for (size_t ci = 2 * bi; ci < std::min(2 * bi + 2, below.columns); ci++) {
+                        s = merge(s, (block_state)below.states[cj * below.columns + ci]);
+                    }
+                }
+                next.states[bj * next.columns + bi] = s;
+            }
+        }
+        levels.push_back(std::move(next));
+    }
+}
+
+size_t MaskPyramid::Rows() const { return rows; }
+size_t MaskPyramid::Columns() const { return columns; }
+
+bool MaskPyramid::sea(size_t j, size_t i) const {
+    return (bits[i * words + j / 64] >> (j % 64)) & 1;
+}
+
+MaskPyramid::block_state MaskPyramid::merge(int a, block_state b) {
+    return (a == NONE || a == b) ? b : MIXED;
+}
+
+// The bits of the rows j0..j1 within a word
+uint64_t MaskPyramid::rowBits(size_t word, size_t j0, size_t j1) const {
+    size_t lo = std::max(j0, word * 64) - word * 64;
+    size_t hi = std::min(j1, word * 64 + 63) - word * 64;
+    return (~uint64_t(0) >> (63 - hi)) & (~uint64_t(0) << lo);
+}
+
+MaskPyramid::block_state MaskPyramid::state(size_t j0, size_t i0, size_t j1, size_t i1) const {
+    if (j0 > j1 || i0 > i1 || j1 >= rows || i1 >= columns) {
+        return LAND;
+    }
+    return state(levels.size() - 1, 0, 0, j0, i0, j1, i1);
+}
+
+// Descends only into the mixed blocks the region covers in part
+MaskPyramid::block_state MaskPyramid::state(size_t l, size_t bj, size_t bi, size_t j0, size_t i0, size_t j1, size_t i1) const {
+    block_state s = (block_state)levels[l].states[bj * levels[l].columns + bi];
+    if (s != MIXED) {
+        return s;
+    }
+
+    size_t blockRows = size_t(64) << l, blockColumns = blockSize << l;
+    bool covered = j0 <= bj * blockRows && (bj + 1) * blockRows - 1 <= j1 && i0 <= bi * blockColumns && (bi + 1) * blockColumns - 1 <= i1;
+    if (covered) {
+        return MIXED;
+    }
+
+    int merged = NONE;
+    if (l == 0) {
+        uint64_t range = rowBits(bj, j0, j1);
+        for (size_t i = std::max(i0, bi * blockSize); i <= std::min(i1, (bi + 1) * blockSize - 1) && merged != MIXED; i++) {
+            uint64_t word = bits[i * words + bj] & range;
+            merged = merge(merged, word == 0 ? LAND : word == range ? SEA : MIXED);
+        }
+        return (block_state)merged;
+    }
+
+    const level &below = levels[l - 1];
+    size_t childRows = blockRows / 2, childColumns = blockColumns / 2;
+    for (size_t cj = 2 * bj; cj < std::min(2 * bj + 2, below.rows) && merged != MIXED; cj++) {
+        if (cj * childRows > j1 || (cj + 1) * childRows - 1 < j0) {
+            continue;
+        }
+        for (size_t ci = 2 * bi; ci < std::min(2 * bi + 2, below.columns) && merged != MIXED; ci++) {
+            if (ci * childColumns > i1 || (ci + 1) * childColumns - 1 < i0) {
+                continue;
+            }
+            merged = merge(merged, state(l - 1, cj, ci, j0, i0, j1, i1));
+        }
+    }
+    return (block_state)merged;
+}
+
+void MaskPyramid::seaCells(size_t i, size_t j0, size_t j1, std::vector<std::array<int, 2>> &cells) const {
+    if (j0 > j1) {
+        return;
+    }
+    for (size_t w = j0 / 64; w <= j1 / 64; w++) {
+        uint64_t word = bits[i * words + w] & rowBits(w, j0, j1);
+        while (word != 0) {
+            cells.push_back({int(w * 64 + __builtin_ctzll(word)), int(i)});
+            word &= word - 1;
+        }
+    }
+}
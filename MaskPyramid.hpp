@@ -0,0 +1,54 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#ifndef AIQUAMPLUSPLUS_MASKPYRAMID_HPP
+#define AIQUAMPLUSPLUS_MASKPYRAMID_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Land/sea occupancy of a mask, sea being 1: a bit per cell, the rows of each column packed in 64 bit words,
+// and a pyramid of block states. The blocks of the first level are a word by blockSize columns, the ones
+// of each further level 2x2 blocks of the former, up to a single block covering the whole mask.
+class MaskPyramid {
+public:
+    enum block_state : unsigned char { LAND = 0, SEA = 1, MIXED = 2 };
+
+    static const size_t blockSize = 64;
+
+    MaskPyramid(const double *mask, size_t rows, size_t columns);
+
+    size_t Rows() const;
+    size_t Columns() const;
+
+    bool sea(size_t j, size_t i) const;
+
+    // State of the cells of the rows j0..j1 and of the columns i0..i1
+    block_state state(size_t j0, size_t i0, size_t j1, size_t i1) const;
+
+    // Appends the sea cells of the column i within the rows j0..j1, in row order
+    void seaCells(size_t i, size_t j0, size_t j1, std::vector<std::array<int, 2>> &cells) const;
+
+private:
+    struct level {
+        size_t rows;
+        size_t columns;
+        std::vector<unsigned char> states;
+    };
+
+    size_t rows;
+    size_t columns;
+    size_t words;
+    std::vector<uint64_t> bits;
+    std::vector<level> levels;
+
+    uint64_t rowBits(size_t word, size_t j0, size_t j1) const;
+    block_state state(size_t l, size_t bj, size_t bi, size_t j0, size_t i0, size_t j1, size_t i1) const;
+
+    static block_state merge(int a, block_state b);
+};
+
+#endif //AIQUAMPLUSPLUS_MASKPYRAMID_HPP
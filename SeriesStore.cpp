@@ -0,0 +1,205 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#include "SeriesStore.hpp"
+#include "Hash.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char seriesMagic[8] = {'A', 'I', 'Q', 'S', 'T', 'O', 'R', 'E'};
+static const uint32_t seriesVersion = 2;
+
+SeriesStore::SeriesStore(const std::string &fileName): fileName(fileName) {
+    logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("Aiquam"));
+}
+
+SeriesStore::~SeriesStore() {
+    close();
+}
+
+series_header *SeriesStore::header() {
+    return reinterpret_cast<series_header *>(base);
+}
+
+series_slot *SeriesStore::slot(int idx) {
+    return reinterpret_cast<series_slot *>(base + sizeof(series_header)) + idx;
+}
+
+size_t SeriesStore::dataOffset() const {
+    const series_header *h = reinterpret_cast<const series_header *>(base);
+    size_t offset = sizeof(series_header) + h->slots * sizeof(series_slot);
+    return (offset + 63) & ~size_t(63);
+}
+
+float *SeriesStore::data(int idx) const {
+    const series_header *h = reinterpret_cast<const series_header *>(base);
+    return reinterpret_cast<float *>(base + dataOffset()) + idx * h->nCells;
+}
+
+// Maps the store, rebuilding it when it is missing or was made for another grid, cell list or number of slots.
+// The store is locked until it is closed: a job finding it in use by another one, e.g. an overrunning or rerun
+// hour, goes without it rather than resizing or writing it under the other one.
+bool SeriesStore::open(uint64_t gridHash, const std::vector<std::array<int, 2>> &cells, int slots) {
+    close();
+
+    uint64_t cellsHash = fnv1a(cells.data(), cells.size() * sizeof(cells[0]));
+    size_t offset = (sizeof(series_header) + slots * sizeof(series_slot) + 63) & ~size_t(63);
+    size_t expected = offset + (size_t)slots * cells.size() * sizeof(float);
+
+    fd = ::open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        LOG4CPLUS_ERROR(logger, "Unable to open the series store: " << fileName << ": " << strerror(errno));
+        return false;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        LOG4CPLUS_WARN(logger, "The series store is in use by another job, ingesting without it: " << fileName << ": " << strerror(errno));
+        close();
+        return false;
+    }
+
+    series_header current{};
+    struct stat st{};
+    bool valid = fstat(fd, &st) == 0 && (size_t)st.st_size == expected &&
+                 pread(fd, &current, sizeof(current), 0) == sizeof(current) &&
+                 memcmp(current.magic, seriesMagic, sizeof(seriesMagic)) == 0 &&
+                 current.version == seriesVersion && current.slots == (uint32_t)slots &&
+                 current.gridHash == gridHash && current.cellsHash == cellsHash && current.nCells == cells.size();
+
+    if (!valid) {
+        LOG4CPLUS_INFO(logger, "Rebuilding the series store: " << fileName);
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, expected) != 0) {
+            LOG4CPLUS_ERROR(logger, "Unable to resize the series store: " << fileName << ": " << strerror(errno));
+            close();
+            return false;
+        }
+    }
+
+    length = expected;
+    void *mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        LOG4CPLUS_ERROR(logger, "Unable to map the series store: " << fileName << ": " << strerror(errno));
+        base = nullptr;
+        close();
+        return false;
+    }
+    base = static_cast<char *>(mapped);
+
+    if (!valid) {
+        // The file was truncated, so every slot is zeroed and therefore invalid
+        series_header *h = header();
+        memcpy(h->magic, seriesMagic, sizeof(seriesMagic));
+        h->version = seriesVersion;
+        h->slots = slots;
+        h->gridHash = gridHash;
+        h->cellsHash = cellsHash;
+        h->nCells = cells.size();
+        h->clock = 0;
+    }
+
+    // Every run has its own clock value, so that the slots used by it are never recycled by it
+    header()->clock++;
+    return true;
+}
+
+void SeriesStore::close() {
+    if (base) {
+        msync(base, length, MS_SYNC);
+        munmap(base, length);
+        base = nullptr;
+    }
+    // Closing the file releases its lock
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    length = 0;
+}
+
+// An input is identified by its file name, size and modification time to the nanosecond, so a regenerated file
+// is decoded again even when it is written within the same second as the previous one
+bool SeriesStore::key(const std::string &ncInput, std::string &name, uint64_t &size, int64_t &mtime, int64_t &mtimeNsec) {
+    struct stat st{};
+    if (stat(ncInput.c_str(), &st) != 0) {
+        return false;
+    }
+
+    name = ncInput.substr(ncInput.find_last_of('/') + 1);
+    size = st.st_size;
+    mtime = st.st_mtim.tv_sec;
+    mtimeNsec = st.st_mtim.tv_nsec;
+    return name.size() < sizeof(series_slot::name);
+}
+
+// Returns the slot holding the input, or -1 when it has to be decoded
+int SeriesStore::find(const std::string &ncInput) {
+    std::string name;
+    uint64_t size;
+    int64_t mtime, mtimeNsec;
+    if (!base || !key(ncInput, name, size, mtime, mtimeNsec)) {
+        return -1;
+    }
+
+    for (int idx = 0; idx < (int)header()->slots; idx++) {
+        series_slot *s = slot(idx);
+        if (s->valid && s->size == size && s->mtime == mtime && s->mtimeNsec == mtimeNsec && name == s->name) {
+            s->clock = header()->clock;
+            return idx;
+        }
+    }
+    return -1;
+}
+
+const float *SeriesStore::column(int slot) const {
+    return data(slot);
+}
+
+// Stores the values of an input in the least recently used slot not needed by the current run
+bool SeriesStore::put(const std::string &ncInput, const float *values) {
+    std::string name;
+    uint64_t size;
+    int64_t mtime, mtimeNsec;
+    if (!base || !key(ncInput, name, size, mtime, mtimeNsec)) {
+        return false;
+    }
+
+    int target = -1;
+    for (int idx = 0; idx < (int)header()->slots; idx++) {
+        series_slot *s = slot(idx);
+        if (s->clock == header()->clock) {
+            continue;
+        }
+        if (!s->valid) {
+            target = idx;
+            break;
+        }
+        if (target < 0 || s->clock < slot(target)->clock) {
+            target = idx;
+        }
+    }
+    if (target < 0) {
+        LOG4CPLUS_WARN(logger, "No free slot in the series store for: " << ncInput);
+        return false;
+    }
+
+    // Invalidate the slot while its values are replaced
+    series_slot *s = slot(target);
+    s->valid = 0;
+    memcpy(data(target), values, header()->nCells * sizeof(float));
+
+    memset(s->name, 0, sizeof(s->name));
+    memcpy(s->name, name.c_str(), name.size());
+    s->size = size;
+    s->mtime = mtime;
+    s->mtimeNsec = mtimeNsec;
+    s->clock = header()->clock;
+    s->valid = 1;
+    return true;
+}
@@ -0,0 +1,69 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#ifndef AIQUAMPLUSPLUS_SERIESSTORE_HPP
+#define AIQUAMPLUSPLUS_SERIESSTORE_HPP
+
+// log4cplus - https://github.com/log4cplus/log4cplus
+#include "log4cplus/configurator.h"
+#include "log4cplus/logger.h"
+#include "log4cplus/loggingmacros.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct series_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+    uint64_t gridHash;
+    uint64_t cellsHash;
+    uint64_t nCells;
+    uint64_t clock;
+};
+
+struct series_slot {
+    char name[224];
+    uint64_t size;
+    int64_t mtime;
+    int64_t mtimeNsec;
+    uint64_t clock;
+    uint32_t valid;
+    uint32_t reserved;
+};
+
+// On-disk, memory-mapped store of the depth-integrated concentration of each cell, one slot per input file.
+// Slots are recycled least recently used first, so with as many slots as inputs it behaves as a ring
+// over the hourly window. The store is rebuilt when the grid or the cells change.
+class SeriesStore {
+public:
+    explicit SeriesStore(const std::string &fileName);
+    ~SeriesStore();
+
+    bool open(uint64_t gridHash, const std::vector<std::array<int, 2>> &cells, int slots);
+    void close();
+
+    int find(const std::string &ncInput);
+    const float *column(int slot) const;
+    bool put(const std::string &ncInput, const float *values);
+
+private:
+    log4cplus::Logger logger;
+    std::string fileName;
+
+    int fd = -1;
+    size_t length = 0;
+    char *base = nullptr;
+
+    series_header *header();
+    series_slot *slot(int idx);
+    float *data(int idx) const;
+    size_t dataOffset() const;
+
+    bool key(const std::string &ncInput, std::string &name, uint64_t &size, int64_t &mtime, int64_t &mtimeNsec);
+};
+
+#endif //AIQUAMPLUSPLUS_SERIESSTORE_HPP
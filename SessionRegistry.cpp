@@ -0,0 +1,317 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#include "SessionRegistry.hpp"
+#include "Hash.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout of the cache of a model: the header, then the ORT format model, aligned as the mapping of the file is
+struct model_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t modelHash;
+    uint64_t optionsHash;
+    uint64_t length;
+    uint64_t padding[3];
+};
+
+static const char modelCacheMagic[8] = {'A', 'I', 'Q', 'M', 'O', 'D', 'E', 'L'};
+static const uint32_t modelCacheVersion = 1;
+
+// The CPU features, which the optimized graph may depend on through the layout of its kernels
+static uint64_t hostHash() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 5, "flags") == 0) {
+            return fnv1a(line.data(), line.size());
+        }
+    }
+    return fnv1a(nullptr, 0);
+}
+
+mapped_model::mapped_model(void *mapped, size_t length, size_t offset): mapped(mapped), length(length), offset(offset) {}
+
+mapped_model::~mapped_model() {
+    munmap(mapped, length);
+}
+
+const void *mapped_model::Data() const { return static_cast<const char *>(mapped) + offset; }
+size_t mapped_model::Size() const { return length - offset; }
+
+SessionRegistry::~SessionRegistry() = default;
+
+SessionRegistry::SessionRegistry(std::shared_ptr<Config> config, int cores): config(config), cores(std::max(cores, 1)) {
+    logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("Aiquam"));
+
+    const config_runtime &runtime = config->Runtime();
+#ifdef USE_OMP
+    workers = runtime.workers > 0 ? runtime.workers : this->cores;
+#else
+    workers = 1;
+#endif
+
+    Ort::ThreadingOptions threading;
+    threading.SetGlobalIntraOpNumThreads(intraOpThreads(runtime));
+    threading.SetGlobalInterOpNumThreads(std::max(runtime.inter_op_threads, 1));
+    threading.SetGlobalSpinControl(runtime.spinning ? 1 : 0);
+    env = std::make_unique<Ort::Env>(threading, ORT_LOGGING_LEVEL_WARNING, "Aiquam");
+
+    if (runtime.cpu_arena) {
+        int extendStrategy;
+        if (runtime.arena_extend_strategy == "next_power_of_two") {
+            extendStrategy = 0;
+        } else if (runtime.arena_extend_strategy == "same_as_requested") {
+            extendStrategy = 1;
+        } else {
+            throw std::runtime_error("Unknown arena extend strategy: " + runtime.arena_extend_strategy);
+        }
+
+        Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        Ort::ArenaCfg arena_cfg(runtime.arena_max_mem, extendStrategy, -1, -1);
+        env->CreateAndRegisterAllocator(memory_info, arena_cfg);
+        envArena = true;
+    }
+
+    LOG4CPLUS_INFO(logger, "Inference on " << workers << " workers of " << this->cores << " threads, " << intraOpThreads(runtime) << " threads a run");
+}
+
+int SessionRegistry::Workers() const {
+    return workers;
+}
+
+// Unless it is set, a run gets the threads the workers leave free. On the pools of the environment they are
+// shared by all the runs, each of which also works on the thread calling it, otherwise they are split among them.
+int SessionRegistry::intraOpThreads(const config_runtime &runtime) const {
+    if (runtime.intra_op_threads > 0) {
+        return runtime.intra_op_threads;
+    }
+    if (runtime.shared_threads) {
+        return std::max(cores - workers + 1, 1);
+    }
+    return std::max(cores / workers, 1);
+}
+
+Ort::SessionOptions SessionRegistry::sessionOptions(const config_runtime &runtime, int gpu_id) const {
+    Ort::SessionOptions session_options;
+
+    if (runtime.shared_threads) {
+        session_options.DisablePerSessionThreads();
+    } else {
+        session_options.SetIntraOpNumThreads(intraOpThreads(runtime));
+        session_options.SetInterOpNumThreads(std::max(runtime.inter_op_threads, 1));
+        session_options.AddConfigEntry("session.intra_op.allow_spinning", runtime.spinning ? "1" : "0");
+        session_options.AddConfigEntry("session.inter_op.allow_spinning", runtime.spinning ? "1" : "0");
+    }
+
+    if (runtime.cpu_arena) {
+        session_options.EnableCpuMemArena();
+        if (envArena) {
+            session_options.AddConfigEntry("session.use_env_allocators", "1");
+        }
+    } else {
+        session_options.DisableCpuMemArena();
+    }
+
+    if (runtime.mem_pattern) {
+        session_options.EnableMemPattern();
+    } else {
+        session_options.DisableMemPattern();
+    }
+
+    if (runtime.graph_optimization == "disable") {
+        session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+    } else if (runtime.graph_optimization == "basic") {
+        session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_BASIC);
+    } else if (runtime.graph_optimization == "extended") {
+        session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+    } else if (runtime.graph_optimization == "all") {
+        session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+    } else {
+        throw std::runtime_error("Unknown graph optimization level: " + runtime.graph_optimization);
+    }
+
+    if (runtime.execution_mode == "sequential") {
+        session_options.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+    } else if (runtime.execution_mode == "parallel") {
+        session_options.SetExecutionMode(ExecutionMode::ORT_PARALLEL);
+    } else {
+        throw std::runtime_error("Unknown execution mode: " + runtime.execution_mode);
+    }
+
+    if (runtime.execution_provider != "cuda" && runtime.execution_provider != "cpu") {
+        throw std::runtime_error("Unknown execution provider: " + runtime.execution_provider);
+    }
+#ifdef USE_CUDA
+    if (gpu_id >= 0 && runtime.execution_provider == "cuda") {
+      Ort::ThrowOnError(OrtSessionOptionsAppendExecutionProvider_CUDA(
+          session_options, gpu_id));
+    }
+#endif
+
+    return session_options;
+}
+
+model_sessions &SessionRegistry::Sessions(int gpu_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::unique_ptr<model_sessions> &models = devices[gpu_id];
+    if (!models) {
+        models = std::make_unique<model_sessions>();
+        load(gpu_id, *models);
+    }
+    return *models;
+}
+
+void SessionRegistry::load(int gpu_id, model_sessions &models) {
+    size_t batchSize = std::max(config->BatchSize(), 1);
+    for (const auto& model : config->Models()) {
+        if (model.input_shape.empty() || model.output_shape.empty()) {
+            throw std::runtime_error("Missing input or output shape");
+        }
+        if (model.output_type != "float" && model.output_type != "int64_t") {
+            throw std::runtime_error("Unsupported output type");
+        }
+
+        Ort::SessionOptions session_options = sessionOptions(model.runtime, gpu_id);
+        models.sessions.push_back(open(model, session_options, gpu_id, models));
+
+        model_layout layout;
+        layout.input = model.input.c_str();
+        layout.output = model.output.c_str();
+        layout.inputShape = model.input_shape;
+        layout.outputShape = model.output_shape;
+        layout.classes = 1;
+        for (size_t d = 1; d < layout.outputShape.size(); d++) {
+            layout.classes *= layout.outputShape[d];
+        }
+        layout.floatOutput = model.output_type == "float";
+
+        // A model exported with a dynamic batch axis takes any number of samples at once
+        std::vector<int64_t> shape = models.sessions.back().GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if (shape.empty() || shape[0] <= 0) {
+            layout.batchSize = batchSize;
+            layout.fixedBatch = false;
+        } else {
+            layout.batchSize = shape[0];
+            layout.fixedBatch = true;
+            LOG4CPLUS_DEBUG(logger, model.name << ": fixed batch axis of " << shape[0]);
+        }
+        models.layouts.push_back(layout);
+    }
+    LOG4CPLUS_INFO(logger, "Loaded " << models.sessions.size() << " models on " << (gpu_id >= 0 ? "GPU " + std::to_string(gpu_id) : std::string("CPU")));
+}
+
+// Opens the session of a model run on the CPU from its cache, as long as neither the model nor the settings it was
+// optimized with changed since it was saved, otherwise from the model itself, saving the optimized graph in the cache
+Ort::Session SessionRegistry::open(const config_model &model, Ort::SessionOptions &session_options, int gpu_id, model_sessions &models) {
+    const char* model_path_cstr = model.name.c_str();
+
+    bool cpu = gpu_id < 0 || model.runtime.execution_provider == "cpu";
+#ifndef USE_CUDA
+    cpu = true;
+#endif
+    uint64_t modelHash = fnv1a(nullptr, 0);
+    if (!model.runtime.model_cache || !cpu || !hashFile(model.name, modelHash)) {
+        return Ort::Session(*env, model_path_cstr, session_options);
+    }
+
+    string options = Ort::GetVersionString() + " " + model.runtime.graph_optimization;
+    uint64_t optionsHash = fnv1a(options.data(), options.size(), hostHash());
+    string cacheName = model.name + ".cache";
+
+    std::unique_ptr<mapped_model> cached = loadCache(cacheName, modelHash, optionsHash);
+    if (cached) {
+        Ort::SessionOptions cache_options = session_options.Clone();
+        cache_options.AddConfigEntry("session.load_model_format", "ORT");
+        cache_options.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+        cache_options.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+        try {
+            Ort::Session session(*env, cached->Data(), cached->Size(), cache_options);
+            LOG4CPLUS_DEBUG(logger, model.name << ": from cache " << cacheName);
+            models.mapped.push_back(std::move(cached));
+            return session;
+        } catch (const Ort::Exception &e) {
+            LOG4CPLUS_WARN(logger, "Unable to load the model cache: " << cacheName << ": " << e.what());
+        }
+    }
+
+    string ortName = cacheName + "." + std::to_string(getpid()) + ".ort";
+    Ort::SessionOptions save_options = session_options.Clone();
+    save_options.SetOptimizedModelFilePath(ortName.c_str());
+    save_options.AddConfigEntry("session.save_model_format", "ORT");
+    try {
+        Ort::Session session(*env, model_path_cstr, save_options);
+        saveCache(cacheName, ortName, modelHash, optionsHash);
+        return session;
+    } catch (const Ort::Exception &e) {
+        LOG4CPLUS_WARN(logger, "Unable to save the model cache: " << cacheName << ": " << e.what());
+        std::remove(ortName.c_str());
+    }
+    return Ort::Session(*env, model_path_cstr, session_options);
+}
+
+std::unique_ptr<mapped_model> SessionRegistry::loadCache(const string &cacheName, uint64_t modelHash, uint64_t optionsHash) {
+    int fd = ::open(cacheName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(model_cache_header)) {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t length = st.st_size;
+    void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto cached = std::make_unique<mapped_model>(mapped, length, sizeof(model_cache_header));
+    const model_cache_header *header = static_cast<const model_cache_header *>(mapped);
+    bool valid = memcmp(header->magic, modelCacheMagic, sizeof(modelCacheMagic)) == 0 &&
+                 header->version == modelCacheVersion && header->modelHash == modelHash && header->optionsHash == optionsHash &&
+                 header->length == length - sizeof(model_cache_header);
+    return valid ? std::move(cached) : nullptr;
+}
+
+// Prepends the header to the ORT format model saved by the session, writing a temporary file renamed at the end so
+// that readers, the other ranks included, never see a partial cache
+void SessionRegistry::saveCache(const string &cacheName, const string &ortName, uint64_t modelHash, uint64_t optionsHash) {
+    std::ifstream ort(ortName, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(ort)), std::istreambuf_iterator<char>());
+    bool read = ort.good() || ort.eof();
+    ort.close();
+    std::remove(ortName.c_str());
+
+    model_cache_header header{};
+    memcpy(header.magic, modelCacheMagic, sizeof(modelCacheMagic));
+    header.version = modelCacheVersion;
+    header.modelHash = modelHash;
+    header.optionsHash = optionsHash;
+    header.length = bytes.size();
+
+    string tmpName = cacheName + "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream file(tmpName, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(bytes.data(), bytes.size());
+    file.close();
+
+    if (!read || bytes.empty() || !file || std::rename(tmpName.c_str(), cacheName.c_str()) != 0) {
+        LOG4CPLUS_WARN(logger, "Unable to save the model cache: " << cacheName);
+        std::remove(tmpName.c_str());
+        return;
+    }
+    LOG4CPLUS_INFO(logger, "Saved the model cache: " << cacheName);
+}
\ No newline at end of file
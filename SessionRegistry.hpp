@@ -0,0 +1,103 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#ifndef AIQUAMPLUSPLUS_SESSIONREGISTRY_HPP
+#define AIQUAMPLUSPLUS_SESSIONREGISTRY_HPP
+
+// log4cplus - https://github.com/log4cplus/log4cplus
+#include "log4cplus/configurator.h"
+#include "log4cplus/logger.h"
+#include "log4cplus/loggingmacros.h"
+#include "onnxruntime_cxx_api.h"
+
+#include "Config.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// What a model takes and gives, resolved when it is loaded. The first axis of the shapes is the batch one.
+struct model_layout {
+    const char *input;
+    const char *output;
+    std::vector<int64_t> inputShape;
+    std::vector<int64_t> outputShape;
+
+    // The values per sample of the output, and whether they are floats rather than int64_t
+    size_t classes;
+    bool floatOutput;
+
+    // The samples the model is run on at once, the configured batch size unless its batch axis is fixed,
+    // in which case a shorter batch is padded to it
+    size_t batchSize;
+    bool fixedBatch;
+};
+
+// An ORT format model mapped from its cache, which the session runs on in place
+struct mapped_model {
+    mapped_model(void *mapped, size_t length, size_t offset);
+    ~mapped_model();
+
+    mapped_model(const mapped_model &) = delete;
+    mapped_model &operator=(const mapped_model &) = delete;
+
+    const void *Data() const;
+    size_t Size() const;
+
+private:
+    void *mapped;
+    size_t length;
+    size_t offset;
+};
+
+// The sessions of the models on a device, one per model in the order of the configuration
+struct model_sessions {
+    // Declared before the sessions, which must not outlive them
+    std::vector<std::unique_ptr<mapped_model>> mapped;
+
+    std::vector<Ort::Session> sessions;
+    std::vector<model_layout> layouts;
+};
+
+// The models of a process, loaded once per device and run concurrently by all the threads. The sessions
+// have no thread pools of their own: they share the ones of the environment, and allocate from its CPU arena.
+class SessionRegistry {
+public:
+    // The workers and the threads of the runs share out the cores of the rank
+    SessionRegistry(std::shared_ptr<Config> config, int cores);
+    ~SessionRegistry();
+
+    SessionRegistry(const SessionRegistry &) = delete;
+    SessionRegistry &operator=(const SessionRegistry &) = delete;
+
+    // The sessions on the GPU gpu_id, or on the CPU if it is negative, loaded by the first thread asking for them
+    model_sessions &Sessions(int gpu_id = -1);
+
+    // The threads running the models
+    int Workers() const;
+
+private:
+    log4cplus::Logger logger;
+    std::shared_ptr<Config> config;
+    int cores;
+    int workers;
+
+    // Declared before the sessions, which must not outlive it
+    std::unique_ptr<Ort::Env> env;
+    bool envArena = false;
+
+    std::mutex mutex;
+    std::map<int, std::unique_ptr<model_sessions>> devices;
+
+    int intraOpThreads(const config_runtime &runtime) const;
+    Ort::SessionOptions sessionOptions(const config_runtime &runtime, int gpu_id) const;
+    void load(int gpu_id, model_sessions &models);
+
+    Ort::Session open(const config_model &model, Ort::SessionOptions &session_options, int gpu_id, model_sessions &models);
+    std::unique_ptr<mapped_model> loadCache(const string &cacheName, uint64_t modelHash, uint64_t optionsHash);
+    void saveCache(const string &cacheName, const string &ortName, uint64_t modelHash, uint64_t optionsHash);
+};
+
+#endif //AIQUAMPLUSPLUS_SESSIONREGISTRY_HPP
@@ -0,0 +1,149 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#include "ShapeFile.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Both files start with a 100 bytes header, the .shx then has 8 bytes per record. The integers of the headers
+// of the files and of the records are big endian, the content of the records is little endian.
+static const size_t headerLength = 100;
+static const size_t indexLength = 8;
+static const uint32_t fileCode = 9994;
+
+static uint32_t bigEndian(const unsigned char *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+static uint32_t littleEndian(const unsigned char *p) {
+    return (uint32_t(p[3]) << 24) | (uint32_t(p[2]) << 16) | (uint32_t(p[1]) << 8) | uint32_t(p[0]);
+}
+
+static bool hostLittleEndian() {
+    const uint16_t one = 1;
+    unsigned char first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+ShapeFile::ShapeFile(const std::string &fileName) {
+    shp = map(fileName, shpLength);
+    shx = map(fileName.substr(0, fileName.size() - 3) + "shx", shxLength);
+
+    if (!shp || !shx || shpLength < headerLength || shxLength < headerLength ||
+        bigEndian(shp) != fileCode || bigEndian(shx) != fileCode) {
+        unmap();
+    }
+}
+
+ShapeFile::~ShapeFile() {
+    unmap();
+}
+
+void ShapeFile::unmap() {
+    if (shp) {
+        munmap(const_cast<unsigned char *>(shp), shpLength);
+    }
+    if (shx) {
+        munmap(const_cast<unsigned char *>(shx), shxLength);
+    }
+    shp = shx = nullptr;
+    shpLength = shxLength = 0;
+}
+
+const unsigned char *ShapeFile::map(const std::string &fileName, size_t &length) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    length = st.st_size;
+    void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        length = 0;
+        return nullptr;
+    }
+    return static_cast<const unsigned char *>(mapped);
+}
+
+bool ShapeFile::IsOpen() const { return shp != nullptr; }
+
+size_t ShapeFile::Records() const {
+    return IsOpen() ? (shxLength - headerLength) / indexLength : 0;
+}
+
+int ShapeFile::ShapeType() const {
+    return IsOpen() ? (int)littleEndian(shp + 32) : 0;
+}
+
+// A polygon record is its type, its bounding box, the number of parts and of points, the start of each part
+// and the x and y of the points, followed by their z and m, if any
+bool ShapeFile::polygon(size_t record, shape_polygon &shape) const {
+    shape.parts.clear();
+    shape.points = nullptr;
+    shape.nPoints = 0;
+
+    if (record >= Records()) {
+        return false;
+    }
+
+    const unsigned char *index = shx + headerLength + record * indexLength;
+    size_t offset = size_t(bigEndian(index)) * 2 + 8;
+    size_t length = size_t(bigEndian(index + 4)) * 2;
+    if (offset + length > shpLength || length < 44) {
+        return false;
+    }
+
+    const unsigned char *content = shp + offset;
+    uint32_t type = littleEndian(content);
+    if (type != POLYGON && type != POLYGONZ && type != POLYGONM) {
+        return false;
+    }
+
+    size_t nParts = littleEndian(content + 36);
+    size_t nPoints = littleEndian(content + 40);
+    if (nParts > length || nPoints > length || 44 + 4 * nParts + 16 * nPoints > length) {
+        return false;
+    }
+
+    shape.parts.resize(nParts);
+    for (size_t part = 0; part < nParts; part++) {
+        shape.parts[part] = littleEndian(content + 44 + 4 * part);
+        if (shape.parts[part] >= nPoints) {
+            return false;
+        }
+    }
+
+    // The points are used in place unless they are misaligned or in the wrong byte order
+    const unsigned char *points = content + 44 + 4 * nParts;
+    bool little = hostLittleEndian();
+    if (little && reinterpret_cast<uintptr_t>(points) % alignof(double) == 0) {
+        shape.points = reinterpret_cast<const double *>(points);
+    } else {
+        shape.buffer.resize(2 * nPoints);
+        if (little) {
+            memcpy(shape.buffer.data(), points, 16 * nPoints);
+        } else {
+            for (size_t k = 0; k < 2 * nPoints; k++) {
+                uint64_t bits = (uint64_t(littleEndian(points + 8 * k + 4)) << 32) | littleEndian(points + 8 * k);
+                memcpy(&shape.buffer[k], &bits, sizeof(double));
+            }
+        }
+        shape.points = shape.buffer.data();
+    }
+    shape.nPoints = nPoints;
+    return true;
+}
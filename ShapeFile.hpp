@@ -0,0 +1,51 @@
+//
+// Created by Ciro De Vita on 17/10/26.
+//
+
+#ifndef AIQUAMPLUSPLUS_SHAPEFILE_HPP
+#define AIQUAMPLUSPLUS_SHAPEFILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// The rings of a polygon record: the ring r is made of the points parts[r]..parts[r+1], the last one ending
+// with the record. The x and y of the points are interleaved, in the mapped file itself when they are aligned.
+struct shape_polygon {
+    std::vector<size_t> parts;
+    const double *points = nullptr;
+    size_t nPoints = 0;
+    std::vector<double> buffer;
+};
+
+// Read only view of the records of a shapefile, the .shp and its .shx index being memory mapped.
+// The records are located through the index only, so any of them can be read concurrently.
+class ShapeFile {
+public:
+    // The shape types of the records holding polygons
+    enum shape_type { POLYGON = 5, POLYGONZ = 15, POLYGONM = 25 };
+
+    explicit ShapeFile(const std::string &fileName);
+    ~ShapeFile();
+
+    ShapeFile(const ShapeFile &) = delete;
+    ShapeFile &operator=(const ShapeFile &) = delete;
+
+    bool IsOpen() const;
+    size_t Records() const;
+    int ShapeType() const;
+
+    // Reads the record, returning false if it is not a polygon or if it is malformed
+    bool polygon(size_t record, shape_polygon &shape) const;
+
+private:
+    const unsigned char *shp = nullptr;
+    size_t shpLength = 0;
+    const unsigned char *shx = nullptr;
+    size_t shxLength = 0;
+
+    void unmap();
+    static const unsigned char *map(const std::string &fileName, size_t &length);
+};
+
+#endif //AIQUAMPLUSPLUS_SHAPEFILE_HPP
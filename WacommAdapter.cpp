@@ -3,12 +3,43 @@
 //
 
 #include "WacommAdapter.hpp"
+#include "Hash.hpp"
+
+#include "hdf5.h"
+#include "zlib.h"
 
 using std::chrono::high_resolution_clock;
 using std::chrono::duration_cast;
 using std::chrono::duration;
 using std::chrono::milliseconds;
 
+std::mutex WacommAdapter::ioMutex;
+
+// The Fletcher-32 checksum as HDF5 computes it: big endian 16 bit words, the odd byte, if any, padded with zero
+static uint32_t fletcher32(const unsigned char *data, size_t size) {
+    uint32_t sum1 = 0, sum2 = 0;
+    size_t words = size / 2;
+    while (words > 0) {
+        size_t block = std::min<size_t>(words, 360);
+        words -= block;
+        for (size_t w = 0; w < block; w++, data += 2) {
+            sum1 += (uint32_t(data[0]) << 8) | data[1];
+            sum2 += sum1;
+        }
+        sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+        sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+    }
+    if (size % 2) {
+        sum1 += uint32_t(data[0]) << 8;
+        sum2 += sum1;
+        sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+        sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+    }
+    sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+    sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+    return (sum2 << 16) | sum1;
+}
+
 WacommAdapter::WacommAdapter(std::string &fileName): fileName(fileName) {
     logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("Aiquam"));
 }
@@ -21,115 +52,557 @@ Array::Array1<double> &WacommAdapter::Lat() { return _data.lat; }
 Array::Array1<double> &WacommAdapter::Lon() { return _data.lon; }
 Array::Array1<double> &WacommAdapter::LatRad() { return _data.latRad; }
 Array::Array1<double> &WacommAdapter::LonRad() { return _data.lonRad; }
-Array::Array4<double> &WacommAdapter::Conc() { return _data.conc; }
-Array::Array3<double> &WacommAdapter::Sfconc() { return _data.sfconc; }
+Array::Array4<conc_t, conc_alloc> &WacommAdapter::Conc() { return _data.conc; }
+Array::Array3<conc_t, conc_alloc> &WacommAdapter::Sfconc() { return _data.sfconc; }
 Array::Array2<double> &WacommAdapter::Mask() { return _data.mask; }
+const MaskPyramid &WacommAdapter::Pyramid() const { return *grid->pyramid; }
 double &WacommAdapter::FillValue() { return _data.fillValue; }
 
 wacomm_data *WacommAdapter::dataptr() {
     return &_data;
 }
 
+std::shared_ptr<const wacomm_grid> WacommAdapter::Grid() const {
+    return grid;
+}
+
+void WacommAdapter::Grid(std::shared_ptr<const wacomm_grid> value) {
+    grid = value;
+}
+
+void WacommAdapter::FileName(const std::string &value) {
+    fileName = value;
+}
+
 void WacommAdapter::process() {
     LOG4CPLUS_DEBUG(logger,"Wacomm file loading:"+fileName);
 
+    std::lock_guard<std::mutex> lock(ioMutex);
+
     // Open the file for read access
     netCDF::NcFile dataFile(fileName, netCDF::NcFile::read);
 
+    // Use the grid of the previous inputs, if the file shares it
+    loadGrid(dataFile);
+    size_t dimDepth = grid->dimDepth;
+    size_t dimLat = grid->dimLat;
+    size_t dimLon = grid->dimLon;
+
     // Retrieve the variable named "time"
     netCDF::NcVar varTime=dataFile.getVar("time");
     size_t dimTime = varTime.getDim(0).getSize();
-    Array::Array1<double> time(dimTime);
-    varTime.getVar(time());
 
-    // Retrieve the variable named "depth"
+    // The data buffers are reused by the following inputs with the same shape
+    if (this->Time().Size() != dimTime) {
+        this->Time().Allocate(dimTime);
+    }
+    if (this->Conc().Nx() != dimTime || this->Conc().Ny() != dimDepth || this->Conc().Nz() != dimLat || this->Conc().N4() != dimLon) {
+        this->Conc().Allocate(dimTime,dimDepth,dimLat,dimLon);
+    }
+    if (this->Sfconc().Nx() != dimTime || this->Sfconc().Ny() != dimLat || this->Sfconc().Nz() != dimLon) {
+        this->Sfconc().Allocate(dimTime,dimLat,dimLon);
+    }
+
+    varTime.getVar(this->Time()());
+
+    // Retrieve the variable named "conc", converted by netCDF, if needed, to the storage type
+    netCDF::NcVar varConc=dataFile.getVar("conc");
+    std::vector<size_t> start = {0, 0, 0, 0};
+    std::vector<size_t> count = {dimTime, dimDepth, dimLat, dimLon};
+    varConc.getVar(start, count, this->Conc()());
+
+    // Retrieve the variable named "sfconc"
+    netCDF::NcVar varSfconc=dataFile.getVar("sfconc");
+    varSfconc.getVar(this->Sfconc()());
+}
+
+// Reads only the conc columns under the given (j,i) cells and reduces them over depth as calculateConc() does.
+// The raw chunks holding the cells are fetched while holding the I/O lock and are inflated after releasing it,
+// so that several files can be processed concurrently; other layouts fall back to hyperslab reads.
+void WacommAdapter::processCells(const std::vector<std::array<int, 2>> &cells, std::vector<float> &values) {
+    LOG4CPLUS_DEBUG(logger,"Wacomm file gathering:"+fileName);
+
+    values.assign(cells.size(), 0.0f);
+
+    size_t dimDepth = 0;
+    std::vector<wacomm_tile> tiles;
+    {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        if (!readChunks(cells, dimDepth, tiles)) {
+            gatherCells(cells, values);
+            return;
+        }
+    }
+
+    size_t latLon = chunkDims[2] * chunkDims[3];
+    std::vector<unsigned char> chunk;
+    for (const auto &tile : tiles) {
+        for (size_t c = 0; c < tile.chunks.size(); c++) {
+            // Chunks never written hold only fill values
+            if (tile.chunks[c].empty()) {
+                continue;
+            }
+
+            if (!decodeChunk(tile.chunks[c], tile.filterMasks[c], chunk)) {
+                LOG4CPLUS_WARN(logger, "Unable to decode a conc chunk of " << fileName << ", reading hyperslabs instead");
+                std::lock_guard<std::mutex> lock(ioMutex);
+                values.assign(cells.size(), 0.0f);
+                gatherCells(cells, values);
+                return;
+            }
+
+            size_t k0 = c * chunkDims[1];
+            size_t nk = std::min(chunkDims[1], dimDepth - k0);
+            for (size_t idx : tile.cells) {
+                size_t offset = (cells[idx][0] - tile.j0) * chunkDims[3] + (cells[idx][1] - tile.i0);
+                float conc = values[idx];
+                for (size_t k = 0; k < nk; k++) {
+                    float current_conc;
+                    if (chunkTypeSize == sizeof(float)) {
+                        float value;
+                        memcpy(&value, chunk.data() + (k * latLon + offset) * sizeof(float), sizeof(float));
+                        current_conc = value;
+                    } else {
+                        double value;
+                        memcpy(&value, chunk.data() + (k * latLon + offset) * sizeof(double), sizeof(double));
+                        current_conc = value;
+                    }
+                    if (current_conc != this->FillValue()) {
+                        conc += current_conc;
+                    }
+                }
+                values[idx] = conc;
+            }
+        }
+    }
+
+    LOG4CPLUS_DEBUG(logger, "Gathered " << cells.size() << " cells from " << tiles.size() << " tiles");
+}
+
+// Identifies the grid by its depth levels up to 30 meters and its coordinates
+uint64_t WacommAdapter::checksum(const Array::Array1<double> &depth, size_t dimDepth, const Array::Array1<double> &lat, const Array::Array1<double> &lon) {
+    uint64_t hash = fnv1a(depth(), dimDepth * sizeof(double));
+    hash = fnv1a(lat(), lat.Size() * sizeof(double), hash);
+    hash = fnv1a(lon(), lon.Size() * sizeof(double), hash);
+    return hash;
+}
+
+// Loads the conc fill value and makes the adapter use the grid of the file, read through netCDF
+void WacommAdapter::loadGrid(netCDF::NcFile &dataFile) {
+    wacomm_coords coords;
+    netCDF::NcVarAtt fillValueAtt = dataFile.getVar("conc").getAtt("_FillValue");
+    fillValueAtt.getValues(&coords.fillValue);
+
+    // Retrieve the coordinate variables
     netCDF::NcVar varDepth = dataFile.getVar("depth");
+    netCDF::NcVar varLat = dataFile.getVar("latitude");
+    netCDF::NcVar varLon = dataFile.getVar("longitude");
     size_t totalDepth = varDepth.getDim(0).getSize();
-    Array::Array1<double> fullDepth(totalDepth);
-    varDepth.getVar(fullDepth());
+
+    // The coordinates of a curvilinear grid are 2D, latitude x longitude
+    coords.curvilinear = varLat.getDimCount() == 2;
+    coords.dimLat = varLat.getDim(0).getSize();
+    coords.dimLon = coords.curvilinear ? varLat.getDim(1).getSize() : varLon.getDim(0).getSize();
+
+    // The coordinates are read in place, into the arrays a new grid is then made of
+    coords.depth.Allocate(totalDepth);
+    coords.lat.Allocate(coords.curvilinear ? coords.dimLat * coords.dimLon : coords.dimLat);
+    coords.lon.Allocate(coords.curvilinear ? coords.dimLat * coords.dimLon : coords.dimLon);
+    varDepth.getVar(coords.depth());
+    varLat.getVar(coords.lat());
+    varLon.getVar(coords.lon());
+
+    useGrid(coords, [&dataFile](double *mask) {
+        // Retrieve the variable named "mask"
+        dataFile.getVar("mask").getVar(mask);
+        return true;
+    });
+}
+
+// Makes the adapter use the grid of the coordinates: the shared one when they match its dimensions and values,
+// otherwise a new one made of them, its mask read by readMask. Returns false, leaving the adapter as it was,
+// if the mask could not be read.
+bool WacommAdapter::useGrid(wacomm_coords &coords, const std::function<bool(double *)> &readMask) {
+    Array::Array1<double> &depth = coords.depth, &lat = coords.lat, &lon = coords.lon;
+    size_t totalDepth = depth.Size(), dimLat = coords.dimLat, dimLon = coords.dimLon;
+    bool curvilinear = coords.curvilinear;
 
     // Determine number of depth levels up to 30 meters
     size_t dimDepth = 0;
     for (size_t i = 0; i < totalDepth; i++) {
-        if (fullDepth(i) <= 30.0) {
+        if (depth[i] <= 30.0) {
             dimDepth++;
         } else {
             break;
         }
     }
-    Array::Array1<double> depth(dimDepth);
-    for (size_t i = 0; i < dimDepth; i++) {
-        depth[i] = fullDepth[i];
+
+    uint64_t hash = checksum(depth, dimDepth, lat, lon);
+    bool sameGrid = grid && grid->dimDepth == dimDepth && grid->dimLat == dimLat && grid->dimLon == dimLon &&
+                    grid->curvilinear == curvilinear && grid->checksum == hash;
+
+    if (!sameGrid) {
+        if (grid) {
+            LOG4CPLUS_WARN(logger, "The grid of " << fileName << " differs from the one of the previous inputs");
+        }
+
+        auto fileGrid = std::make_shared<wacomm_grid>();
+        fileGrid->dimDepth = dimDepth;
+        fileGrid->dimLat = dimLat;
+        fileGrid->dimLon = dimLon;
+        fileGrid->curvilinear = curvilinear;
+        fileGrid->checksum = hash;
+        fileGrid->latRad.Allocate(lat.Size());
+        fileGrid->lonRad.Allocate(lon.Size());
+        fileGrid->mask.Allocate(dimLat, dimLon);
+
+        // All the depth levels are kept, the adapters viewing the first dimDepth ones
+        fileGrid->depth = std::move(depth);
+        fileGrid->lat = std::move(lat);
+        fileGrid->lon = std::move(lon);
+
+        if (!readMask(fileGrid->mask())) {
+            return false;
+        }
+
+        size_t nLat = fileGrid->lat.Size(), nLon = fileGrid->lon.Size();
+
+        #pragma omp parallel for collapse(1) default(none) shared(nLat, fileGrid)
+        for (int i=0; i<nLat;i++) {
+            fileGrid->latRad(i)=0.0174533*fileGrid->lat(i);
+        }
+
+        #pragma omp parallel for collapse(1) default(none) shared(nLon, fileGrid)
+        for (int i=0; i<nLon;i++) {
+            fileGrid->lonRad(i)=0.0174533*fileGrid->lon(i);
+        }
+
+        if (curvilinear) {
+            fileGrid->index = std::make_unique<GridIndex>(fileGrid->latRad(), fileGrid->lonRad(), dimLat, dimLon);
+        } else {
+            fileGrid->index = std::make_unique<GridIndex>(fileGrid->latRad(), dimLat, fileGrid->lonRad(), dimLon);
+        }
+        fileGrid->pyramid = std::make_unique<MaskPyramid>(fileGrid->mask(), dimLat, dimLon);
+
+        grid = fileGrid;
     }
 
+    // The grid variables of the adapter are views on the grid
+    _data.depth.Dimension(grid->dimDepth, grid->depth());
+    _data.lat.Dimension(grid->lat.Size(), grid->lat());
+    _data.lon.Dimension(grid->lon.Size(), grid->lon());
+    _data.latRad.Dimension(grid->latRad.Size(), grid->latRad());
+    _data.lonRad.Dimension(grid->lonRad.Size(), grid->lonRad());
+    _data.mask.Dimension(grid->dimLat, grid->dimLon, grid->mask());
+    _data.fillValue = coords.fillValue;
+    return true;
+}
 
-    // Retrieve the variable named "latitude"
-    netCDF::NcVar varLat=dataFile.getVar("latitude");
-    size_t dimLat = varLat.getDim(0).getSize();
-    Array::Array1<double> lat(dimLat);
-    varLat.getVar(lat());
+// Groups the cells by the tile of the horizontal plane holding them
+void WacommAdapter::groupCells(const std::vector<std::array<int, 2>> &cells, size_t tileLat, size_t tileLon, std::vector<wacomm_tile> &tiles) {
+    std::map<std::pair<size_t, size_t>, size_t> tileIndex;
+    for (size_t idx = 0; idx < cells.size(); idx++) {
+        std::pair<size_t, size_t> key = {cells[idx][0] / tileLat, cells[idx][1] / tileLon};
+        auto it = tileIndex.emplace(key, tiles.size());
+        if (it.second) {
+            wacomm_tile tile;
+            tile.j0 = key.first * tileLat;
+            tile.i0 = key.second * tileLon;
+            tiles.push_back(tile);
+        }
+        tiles[it.first->second].cells.push_back(idx);
+    }
+}
 
-    // Retrieve the variable named "longitude"
-    netCDF::NcVar varLon=dataFile.getVar("longitude");
-    size_t dimLon = varLon.getDim(0).getSize();
-    Array::Array1<double> lon(dimLon);
-    varLon.getVar(lon());
+// The dimensions of a dataset of the file, false if it is missing
+static bool datasetDims(hid_t file, const char *name, std::vector<hsize_t> &dims) {
+    dims.clear();
+    hid_t dataset, space = H5I_INVALID_HID;
+    H5E_BEGIN_TRY {
+        dataset = H5Dopen2(file, name, H5P_DEFAULT);
+        space = dataset < 0 ? H5I_INVALID_HID : H5Dget_space(dataset);
+    } H5E_END_TRY;
+
+    int rank = space < 0 ? -1 : H5Sget_simple_extent_ndims(space);
+    if (rank >= 0) {
+        dims.resize(rank);
+        H5Sget_simple_extent_dims(space, dims.data(), nullptr);
+    }
 
-    // Retrieve the variable named "conc"
-    netCDF::NcVar varConc=dataFile.getVar("conc");
-    Array::Array4<double> conc(dimTime,dimDepth,dimLat,dimLon);
-    netCDF::NcVarAtt fillValueAtt = varConc.getAtt("_FillValue");
-    fillValueAtt.getValues(&_data.fillValue);
-    std::vector<size_t> start = {0, 0, 0, 0};
-    std::vector<size_t> count = {dimTime, dimDepth, dimLat, dimLon};
-    varConc.getVar(start, count, conc());
+    if (space >= 0) H5Sclose(space);
+    if (dataset >= 0) H5Dclose(dataset);
+    return rank >= 0;
+}
 
-    // Retrieve the variable named "sfconc"
-    netCDF::NcVar varSfconc=dataFile.getVar("sfconc");
-    Array::Array3<double> sfconc(dimTime,dimLat,dimLon);
-    varSfconc.getVar(sfconc());
+// Reads a whole dataset of size values of the file, converted to double as netCDF does
+static bool readDataset(hid_t file, const char *name, size_t size, double *values) {
+    std::vector<hsize_t> dims;
+    if (!datasetDims(file, name, dims)) {
+        return false;
+    }
+    size_t count = 1;
+    for (hsize_t dim : dims) {
+        count *= dim;
+    }
+    if (count != size) {
+        return false;
+    }
+
+    herr_t status = -1;
+    H5E_BEGIN_TRY {
+        hid_t dataset = H5Dopen2(file, name, H5P_DEFAULT);
+        if (dataset >= 0) {
+            status = H5Dread(dataset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, values);
+            H5Dclose(dataset);
+        }
+    } H5E_END_TRY;
+    return status >= 0;
+}
+
+// Reads the conc fill value and the coordinates of a netCDF-4 file straight from its HDF5 datasets, as loadGrid()
+// does through netCDF, so that the raw chunks are fetched without opening the file twice
+static bool readCoords(hid_t file, hid_t conc, wacomm_coords &coords) {
+    herr_t status = -1;
+    H5E_BEGIN_TRY {
+        hid_t att = H5Aopen(conc, "_FillValue", H5P_DEFAULT);
+        if (att >= 0) {
+            status = H5Aread(att, H5T_NATIVE_DOUBLE, &coords.fillValue);
+            H5Aclose(att);
+        }
+    } H5E_END_TRY;
+
+    std::vector<hsize_t> depthDims, latDims, lonDims;
+    if (status < 0 || !datasetDims(file, "depth", depthDims) || !datasetDims(file, "latitude", latDims) ||
+        !datasetDims(file, "longitude", lonDims) || depthDims.size() != 1 || latDims.empty() || latDims.size() > 2) {
+        return false;
+    }
+
+    // The coordinates of a curvilinear grid are 2D, latitude x longitude
+    coords.curvilinear = latDims.size() == 2;
+    coords.dimLat = latDims[0];
+    coords.dimLon = coords.curvilinear ? latDims[1] : (lonDims.empty() ? 0 : lonDims[0]);
+
+    coords.depth.Allocate(depthDims[0]);
+    coords.lat.Allocate(coords.curvilinear ? coords.dimLat * coords.dimLon : coords.dimLat);
+    coords.lon.Allocate(coords.curvilinear ? coords.dimLat * coords.dimLon : coords.dimLon);
+    return readDataset(file, "depth", coords.depth.Size(), coords.depth()) &&
+           readDataset(file, "latitude", coords.lat.Size(), coords.lat()) &&
+           readDataset(file, "longitude", coords.lon.Size(), coords.lon());
+}
+
+// Fetches the raw conc chunks of the first time step covering the cells, down to the last level up to 30 meters.
+// Returns false when the file is not HDF5 based or its conc layout, type or filters are not handled here.
+// The file is opened once, by HDF5, its grid being read from the datasets of the netCDF variables.
+bool WacommAdapter::readChunks(const std::vector<std::array<int, 2>> &cells, size_t &dimDepth, std::vector<wacomm_tile> &tiles) {
+#if H5_VERSION_GE(1,12,0)
+    if (H5Fis_accessible(fileName.c_str(), H5P_DEFAULT) <= 0) {
+#else
+    if (H5Fis_hdf5(fileName.c_str()) <= 0) {
+#endif
+        return false;
+    }
+
+    hid_t file = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file < 0) {
+        return false;
+    }
+    hid_t dataset = H5Dopen2(file, "conc", H5P_DEFAULT);
+    hid_t dcpl = dataset < 0 ? H5I_INVALID_HID : H5Dget_create_plist(dataset);
+    hid_t type = dataset < 0 ? H5I_INVALID_HID : H5Dget_type(dataset);
+
+    bool supported = dcpl >= 0 && type >= 0 && H5Pget_layout(dcpl) == H5D_CHUNKED &&
+                     H5Tget_class(type) == H5T_FLOAT && H5Tget_order(type) == H5T_ORDER_LE &&
+                     (H5Tget_size(type) == sizeof(float) || H5Tget_size(type) == sizeof(double));
+
+    hsize_t dims[4];
+    if (supported && H5Pget_chunk(dcpl, 4, dims) == 4) {
+        chunkDims.assign(dims, dims + 4);
+        chunkTypeSize = H5Tget_size(type);
+    } else {
+        supported = false;
+    }
+
+    chunkFilters.clear();
+    int nFilters = supported ? H5Pget_nfilters(dcpl) : 0;
+    for (int idx = 0; idx < nFilters; idx++) {
+        unsigned int flags, filterConfig;
+        size_t nElements = 0;
+        H5Z_filter_t filter = H5Pget_filter2(dcpl, idx, &flags, &nElements, nullptr, 0, nullptr, &filterConfig);
+        if (filter != H5Z_FILTER_DEFLATE && filter != H5Z_FILTER_SHUFFLE && filter != H5Z_FILTER_FLETCHER32) {
+            supported = false;
+        }
+        chunkFilters.push_back(filter);
+    }
+
+    if (supported) {
+        wacomm_coords coords;
+        supported = readCoords(file, dataset, coords);
+        if (supported) {
+            size_t maskSize = coords.dimLat * coords.dimLon;
+            supported = useGrid(coords, [file, maskSize](double *mask) { return readDataset(file, "mask", maskSize, mask); });
+        }
+    }
 
-    // Retrieve the variable named "mask"
-    netCDF::NcVar varmask=dataFile.getVar("mask");
-    Array::Array2<double> mask(dimLat,dimLon);
-    varmask.getVar(mask());
+    if (supported) {
+        dimDepth = grid->dimDepth;
+        groupCells(cells, chunkDims[2], chunkDims[3], tiles);
+
+        size_t depthChunks = (dimDepth + chunkDims[1] - 1) / chunkDims[1];
+        for (auto &tile : tiles) {
+            tile.chunks.resize(depthChunks);
+            tile.filterMasks.resize(depthChunks, 0);
+            for (size_t c = 0; c < depthChunks && supported; c++) {
+                hsize_t offset[4] = {0, c * chunkDims[1], tile.j0, tile.i0};
+                hsize_t nBytes = 0;
+                herr_t status;
+                H5E_BEGIN_TRY {
+                    status = H5Dget_chunk_storage_size(dataset, offset, &nBytes);
+                } H5E_END_TRY;
+                if (status < 0 || nBytes == 0) {
+                    continue;
+                }
+                tile.chunks[c].resize(nBytes);
+                supported = H5Dread_chunk(dataset, H5P_DEFAULT, offset, &tile.filterMasks[c], tile.chunks[c].data()) >= 0;
+            }
+        }
+    }
 
-    this->Time().Allocate(dimTime);
-    this->Depth().Allocate(dimDepth);
-    this->Lat().Allocate(dimLat);
-    this->Lon().Allocate(dimLon);
-    this->LatRad().Allocate(dimLat);
-    this->LonRad().Allocate(dimLon);
-    this->Conc().Allocate(dimTime,dimDepth,dimLat,dimLon);
-    this->Sfconc().Allocate(dimTime,dimLat,dimLon);
-    this->Mask().Allocate(dimLat,dimLon);
+    if (type >= 0) H5Tclose(type);
+    if (dcpl >= 0) H5Pclose(dcpl);
+    if (dataset >= 0) H5Dclose(dataset);
+    H5Fclose(file);
 
-    this->Time().Load(time());
-    this->Depth().Load(depth());
-    this->Lat().Load(lat());
-    this->Lon().Load(lon());
-    this->Conc().Load(conc());
-    this->Sfconc().Load(sfconc());
-    this->Mask().Load(mask());
+    if (!supported) {
+        tiles.clear();
+    }
+    return supported;
+}
 
-    #pragma omp parallel for collapse(1) default(none) shared(dimLat)
-    for (int i=0; i<dimLat;i++) {
-        this->LatRad().operator()(i)=0.0174533*this->Lat()(i);
+// Undoes the filter pipeline of a raw chunk, returning false on a corrupted or truncated chunk
+bool WacommAdapter::decodeChunk(const std::vector<unsigned char> &raw, uint32_t filterMask, std::vector<unsigned char> &chunk) {
+    size_t chunkBytes = chunkTypeSize;
+    for (size_t dim : chunkDims) {
+        chunkBytes *= dim;
     }
 
-    #pragma omp parallel for collapse(1) default(none) shared(dimLon)
-    for (int i=0; i<dimLon;i++) {
-        this->LonRad().operator()(i)=0.0174533*this->Lon()(i);
+    chunk = raw;
+    std::vector<unsigned char> scratch;
+    for (int idx = (int)chunkFilters.size() - 1; idx >= 0; idx--) {
+        if (filterMask & (1u << idx)) {
+            continue;
+        }
+
+        if (chunkFilters[idx] == H5Z_FILTER_FLETCHER32) {
+            if (chunk.size() < 4) {
+                return false;
+            }
+
+            // The checksum is stored little endian after the data. As H5Dread does, the one of the files
+            // written before HDF5 1.6.3 is accepted too, with the bytes of its 16 bit halves swapped.
+            size_t size = chunk.size() - 4;
+            const unsigned char *p = chunk.data() + size;
+            uint32_t stored = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+            uint32_t computed = fletcher32(chunk.data(), size);
+            uint32_t reversed = ((computed & 0x00ff00ffu) << 8) | ((computed >> 8) & 0x00ff00ffu);
+            if (stored != computed && stored != reversed) {
+                return false;
+            }
+            chunk.resize(size);
+        } else if (chunkFilters[idx] == H5Z_FILTER_DEFLATE) {
+            // Leave room for the checksums of the filters applied before deflate
+            uLongf length = chunkBytes + 4 * chunkFilters.size();
+            scratch.resize(length);
+            if (uncompress(scratch.data(), &length, chunk.data(), chunk.size()) != Z_OK) {
+                return false;
+            }
+            scratch.resize(length);
+            chunk.swap(scratch);
+        } else if (chunkFilters[idx] == H5Z_FILTER_SHUFFLE) {
+            size_t n = chunk.size() / chunkTypeSize;
+            scratch.resize(chunk.size());
+            for (size_t b = 0; b < chunkTypeSize; b++) {
+                for (size_t e = 0; e < n; e++) {
+                    scratch[e * chunkTypeSize + b] = chunk[b * n + e];
+                }
+            }
+            chunk.swap(scratch);
+        }
+    }
+
+    return chunk.size() == chunkBytes;
+}
+
+// Reads the columns under the cells by one hyperslab per tile, for files not handled by readChunks()
+void WacommAdapter::gatherCells(const std::vector<std::array<int, 2>> &cells, std::vector<float> &values) {
+    // Open the file for read access
+    netCDF::NcFile dataFile(fileName, netCDF::NcFile::read);
+    loadGrid(dataFile);
+    size_t dimDepth = grid->dimDepth;
+
+    // Retrieve the variable named "conc"
+    netCDF::NcVar varConc=dataFile.getVar("conc");
+
+    // Use the chunk shape on the horizontal plane as the gathering tile
+    size_t tileLat = 64, tileLon = 64;
+    netCDF::NcVar::ChunkMode chunkMode;
+    std::vector<size_t> chunkSizes;
+    varConc.getChunkingParameters(chunkMode, chunkSizes);
+    if (chunkMode == netCDF::NcVar::nc_CHUNKED && chunkSizes.size() == 4) {
+        tileLat = std::max<size_t>(chunkSizes[2], 1);
+        tileLon = std::max<size_t>(chunkSizes[3], 1);
+    }
+
+    std::vector<wacomm_tile> tiles;
+    groupCells(cells, tileLat, tileLon, tiles);
+
+    std::vector<double> buffer;
+    for (const auto &tile : tiles) {
+        int minJ = INT_MAX, minI = INT_MAX, maxJ = INT_MIN, maxI = INT_MIN;
+        for (size_t idx : tile.cells) {
+            minJ = std::min(minJ, cells[idx][0]);
+            maxJ = std::max(maxJ, cells[idx][0]);
+            minI = std::min(minI, cells[idx][1]);
+            maxI = std::max(maxI, cells[idx][1]);
+        }
+        size_t dimJ = maxJ - minJ + 1;
+        size_t dimI = maxI - minI + 1;
+
+        // Read the first time step of the columns covered by the tile
+        buffer.resize(dimDepth * dimJ * dimI);
+        std::vector<size_t> start = {0, 0, (size_t)minJ, (size_t)minI};
+        std::vector<size_t> count = {1, dimDepth, dimJ, dimI};
+        varConc.getVar(start, count, buffer.data());
+
+        for (size_t idx : tile.cells) {
+            size_t offset = (cells[idx][0] - minJ) * dimI + (cells[idx][1] - minI);
+            float conc = 0.0;
+            for (size_t k = 0; k < dimDepth; k++) {
+                float current_conc = buffer[k * dimJ * dimI + offset];
+                if (current_conc != this->FillValue()) {
+                    conc += current_conc;
+                }
+            }
+            values[idx] = conc;
+        }
     }
 }
 
 void WacommAdapter::initializeKDTree() {
+    if (kdTree) {
+        return;
+    }
+
     size_t eta = _data.mask.Nx();
     size_t xi = _data.mask.Ny();
 
+    // The point of the node (j,i) is the j * xi + i
     for (int j = 0; j < eta; j++) {
         for (int i = 0; i < xi; i++) {
-            cloud.points.push_back({_data.latRad(j), _data.lonRad(i)});
+            if (Curvilinear()) {
+                cloud.points.push_back({_data.latRad(j * xi + i), _data.lonRad(j * xi + i)});
+            } else {
+                cloud.points.push_back({_data.latRad(j), _data.lonRad(i)});
+            }
         }
     }
 
@@ -138,48 +611,140 @@ void WacommAdapter::initializeKDTree() {
 }
 
 
+// The KD-tree is only needed when the coordinates are not monotonic
+bool WacommAdapter::Rectilinear() const {
+    return grid && grid->index->Rectilinear();
+}
+
+// The coordinates are 2D, latitude x longitude
+bool WacommAdapter::Curvilinear() const {
+    return grid && grid->curvilinear;
+}
+
 void WacommAdapter::latlon2ji(double lat, double lon, double &j, double &i) {
-    if (!kdTree) {
+    if (!Rectilinear() && !kdTree) {
         LOG4CPLUS_ERROR(logger, "KD-Tree not initialized!");
         return;
     }
 
-    double query[2] = {0.0174533 * lat, 0.0174533 * lon};
-    size_t nearestIdx;
+    cell_hint hint;
+    if (!locate(lat, lon, j, i, hint)) {
+        LOG4CPLUS_ERROR(logger, "Error: Unable to find indices for lat/lon in dataset.");
+        return;
+    }
+
+    LOG4CPLUS_DEBUG(logger, "Interpolated j: " << j << ", i: " << i);
+}
+
+// Converts n points at once, e.g. the vertices of a polygon, the lat and lon of a point being stride values
+// after the ones of the former. On a curvilinear grid each point is searched from the cell of the former one.
+// It can be called concurrently;
+// as for a single point, the j and i of the points that can't be located are left untouched.
+void WacommAdapter::latlon2ji(const double *lat, const double *lon, double *j, double *i, size_t n, size_t stride) {
+    if (!Rectilinear() && !kdTree) {
+        LOG4CPLUS_ERROR(logger, "KD-Tree not initialized!");
+        return;
+    }
+
+    size_t failed = 0;
+    #pragma omp parallel if(n > 4096) default(none) shared(lat, lon, j, i, n, stride) reduction(+:failed)
+    {
+        cell_hint hint;
+
+        #pragma omp for schedule(static)
+        for (long idx = 0; idx < (long)n; idx++) {
+            if (!locate(lat[idx * stride], lon[idx * stride], j[idx], i[idx], hint)) {
+                failed++;
+            }
+        }
+    }
+
+    if (failed) {
+        LOG4CPLUS_ERROR(logger, "Error: Unable to find indices for " << failed << " of " << n << " lat/lon in dataset.");
+    }
+}
+
+// The grid node nearest to the point, in radians, by the KD-tree
+bool WacommAdapter::nearestNode(const double *query, size_t &nearestIdx) const {
+    if (!kdTree) {
+        return false;
+    }
+
     double outDistSqr;
 
     nanoflann::KNNResultSet<double> resultSet(1);
     resultSet.init(&nearestIdx, &outDistSqr);
     kdTree->findNeighbors(resultSet, query, nanoflann::SearchParameters(10));
 
+    return nearestIdx < cloud.points.size();
+}
+
+// Locates a point on a curvilinear grid walking from the cell of the hint, if close enough, otherwise from the
+// cell of the nearest node; should the walk get lost the point is snapped to the node
+bool WacommAdapter::locateCell(const double *query, double &j, double &i, cell_hint &hint) const {
+    const GridIndex &index = *grid->index;
+    size_t cellJ = hint.j, cellI = hint.i;
+    if (!hint.valid || !index.walk(query[0], query[1], cellJ, cellI, j, i, 8)) {
+        size_t nearestIdx;
+        if (!nearestNode(query, nearestIdx)) {
+            return false;
+        }
+
+        size_t xi = _data.mask.Ny();
+        cellJ = nearestIdx / xi;
+        cellI = nearestIdx % xi;
+        if (!index.walk(query[0], query[1], cellJ, cellI, j, i, 256)) {
+            j = nearestIdx / xi;
+            i = nearestIdx % xi;
+        }
+    }
+
+    hint = {cellJ, cellI, true};
+    return true;
+}
+
+// Interpolates the fractional (j,i) of a point from its nearest grid point, or from the cell holding it
+// on a curvilinear grid, without logging. Returns false, leaving j and i untouched, when the point can't be located.
+bool WacommAdapter::locate(double lat, double lon, double &j, double &i, cell_hint &hint) const {
+    double query[2] = {0.0174533 * lat, 0.0174533 * lon};
     size_t eta = _data.mask.Nx();
     size_t xi = _data.mask.Ny();
 
-    if (nearestIdx >= cloud.points.size()) {
-        LOG4CPLUS_ERROR(logger, "KD-Tree index out of bounds: " << nearestIdx);
-        return;
+    if (Curvilinear()) {
+        return locateCell(query, j, i, hint);
     }
 
-    double nearestLat = cloud.points[nearestIdx][0];
-    double nearestLon = cloud.points[nearestIdx][1];
-
     int minJ = -1, minI = -1;
-    for (size_t idx = 0; idx < eta; ++idx) {
-        if (std::abs(_data.latRad(idx) - nearestLat) < 1e-6) {
-            minJ = idx;
-            break;
+    if (Rectilinear()) {
+        size_t nearestJ, nearestI;
+        grid->index->nearest(query[0], query[1], nearestJ, nearestI);
+        minJ = nearestJ;
+        minI = nearestI;
+    } else {
+        size_t nearestIdx;
+        if (!nearestNode(query, nearestIdx)) {
+            return false;
         }
-    }
-    for (size_t idx = 0; idx < xi; ++idx) {
-        if (std::abs(_data.lonRad(idx) - nearestLon) < 1e-6) {
-            minI = idx;
-            break;
+
+        double nearestLat = cloud.points[nearestIdx][0];
+        double nearestLon = cloud.points[nearestIdx][1];
+
+        for (size_t idx = 0; idx < eta; ++idx) {
+            if (std::abs(_data.latRad(idx) - nearestLat) < 1e-6) {
+                minJ = idx;
+                break;
+            }
+        }
+        for (size_t idx = 0; idx < xi; ++idx) {
+            if (std::abs(_data.lonRad(idx) - nearestLon) < 1e-6) {
+                minI = idx;
+                break;
+            }
         }
     }
 
     if (minJ == -1 || minI == -1) {
-        LOG4CPLUS_ERROR(logger, "Error: Unable to find indices for lat/lon in dataset.");
-        return;
+        return false;
     }
 
     double dLat = query[0] - _data.latRad(minJ);
@@ -204,7 +769,12 @@ void WacommAdapter::latlon2ji(double lat, double lon, double &j, double &i) {
         i = minI;
     }
 
-    LOG4CPLUS_DEBUG(logger, "Interpolated j: " << j << ", i: " << i);
+    return true;
+}
+
+// Identifies the grid by its coordinates, so the values derived from it can be matched across runs
+uint64_t WacommAdapter::GridHash() {
+    return grid ? grid->checksum : 0;
 }
 
 // Returns -1 if a < 0 and 1 if a > 0
@@ -219,4 +789,61 @@ float WacommAdapter::calculateConc(double j, double i) {
         }
     }
     return conc;
-}
\ No newline at end of file
+}
+
+// Integrates conc over the depth levels, at the first time step, for all the sea cells at once into the
+// caller provided field of Mask().Nx() x Mask().Ny() values; land cells are set to 0.
+// Each cell gets the same value as calculateConc(), unless doubleAccumulation is set.
+void WacommAdapter::integrateConc(float *field, bool doubleAccumulation) {
+    if (doubleAccumulation) {
+        integrateLevels<double>(field);
+    } else {
+        integrateLevels<float>(field);
+    }
+}
+
+template<typename T>
+void WacommAdapter::integrateLevels(float *field) {
+    size_t dimDepth = this->Conc().Ny();
+    size_t dimLat = this->Conc().Nz();
+    size_t dimLon = this->Conc().N4();
+    size_t plane = dimLat * dimLon;
+    const double *mask = this->Mask()();
+
+    // The levels of the first time step, one block
+    Array::strided<conc_t, 4> levels = this->Conc().slice(0, 1, 0, dimDepth);
+    const conc_t *conc = levels();
+
+    // As in calculateConc(), the values are compared as floats with the fill value,
+    // which never matches if it is not representable as a float
+    double fillValue = this->FillValue();
+    bool hasFill = (double)(float)fillValue == fillValue;
+    float fill = (float)fillValue;
+
+    #pragma omp parallel default(none) shared(field, dimDepth, dimLat, dimLon, plane, conc, mask, hasFill, fill)
+    {
+        std::vector<T> rowConc(dimLon);
+
+        // One row at a time, adding the levels in order over contiguous values
+        #pragma omp for schedule(static)
+        for (long j = 0; j < (long)dimLat; j++) {
+            T *acc = rowConc.data();
+            std::fill(rowConc.begin(), rowConc.end(), T(0));
+            for (size_t k = 0; k < dimDepth; k++) {
+                const conc_t *row = conc + k * plane + j * dimLon;
+                #pragma omp simd
+                for (size_t i = 0; i < dimLon; i++) {
+                    float current_conc = row[i];
+                    acc[i] += (hasFill && current_conc == fill) ? T(0) : T(current_conc);
+                }
+            }
+
+            const double *maskRow = mask + j * dimLon;
+            float *fieldRow = field + j * dimLon;
+            #pragma omp simd
+            for (size_t i = 0; i < dimLon; i++) {
+                fieldRow[i] = maskRow[i] == 1 ? (float)acc[i] : 0.0f;
+            }
+        }
+    }
+}
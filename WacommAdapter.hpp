@@ -11,11 +11,30 @@
 #include "log4cplus/loggingmacros.h"
 
 #include <math.h>
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "Array.h"
+#include "GridIndex.hpp"
+#include "MaskPyramid.hpp"
 #include "netcdf"
 #include <nanoflann.hpp>
 
+// Storage type of the concentration fields, which are reduced in float anyway
+#ifdef USE_DOUBLE_CONC
+typedef double conc_t;
+#else
+typedef float conc_t;
+#endif
+
+// The conc fields are the largest buffers of a run: they come from a pool shared by the adapters of all the inputs,
+// backed by transparent huge pages, their pages first touched by the threads in parallel
+typedef Array::pool<conc_t, Array::firsttouch<conc_t, Array::hugepage<conc_t>>> conc_alloc;
+
 struct wacomm_data {
     Array::Array1<double> time;
     Array::Array1<double> depth;
@@ -23,12 +42,49 @@ struct wacomm_data {
     Array::Array1<double> lon;
     Array::Array1<double> latRad;
     Array::Array1<double> lonRad;
-    Array::Array4<double> conc;
-    Array::Array3<double> sfconc;
+    Array::Array4<conc_t, conc_alloc> conc;
+    Array::Array3<conc_t, conc_alloc> sfconc;
     Array::Array2<double> mask;
     double fillValue;
 };
 
+// The conc fill value and the coordinates of an input, as read from it either through netCDF or straight from
+// its HDF5 datasets, before they are made into a grid or found to match the shared one
+struct wacomm_coords {
+    double fillValue;
+    size_t dimLat;
+    size_t dimLon;
+    bool curvilinear;
+    Array::Array1<double> depth;
+    Array::Array1<double> lat;
+    Array::Array1<double> lon;
+};
+
+// Grid shared, read only, by the adapters of all the inputs of a run
+struct wacomm_grid {
+    size_t dimDepth;
+    size_t dimLat;
+    size_t dimLon;
+    Array::Array1<double> depth;
+    Array::Array1<double> lat;
+    Array::Array1<double> lon;
+    Array::Array1<double> latRad;
+    Array::Array1<double> lonRad;
+    Array::Array2<double> mask;
+    std::unique_ptr<const GridIndex> index;
+    std::unique_ptr<const MaskPyramid> pyramid;
+    bool curvilinear;
+    uint64_t checksum;
+};
+
+struct wacomm_tile {
+    size_t j0;
+    size_t i0;
+    std::vector<size_t> cells;
+    std::vector<std::vector<unsigned char>> chunks;
+    std::vector<uint32_t> filterMasks;
+};
+
 struct PointCloud {
     std::vector<std::array<double, 2>> points; // {lat, lon}
 
@@ -54,34 +110,68 @@ class WacommAdapter {
         ~WacommAdapter();
 
         void process();
+        void processCells(const std::vector<std::array<int, 2>> &cells, std::vector<float> &values);
         void initializeKDTree();
+        bool Rectilinear() const;
+        bool Curvilinear() const;
 
         void latlon2ji(double lat, double lon, double &j, double &i);
+        void latlon2ji(const double *lat, const double *lon, double *j, double *i, size_t n, size_t stride = 1);
 
         float calculateConc(double j, double i);
+        void integrateConc(float *field, bool doubleAccumulation = false);
+
+        uint64_t GridHash();
 
         wacomm_data *dataptr();
 
+        std::shared_ptr<const wacomm_grid> Grid() const;
+        void Grid(std::shared_ptr<const wacomm_grid> value);
+        void FileName(const std::string &value);
+
         Array::Array1<double> &Time();
         Array::Array1<double> &Depth();
         Array::Array1<double> &Lat();
         Array::Array1<double> &Lon();
         Array::Array1<double> &LatRad();
         Array::Array1<double> &LonRad();
-        Array::Array4<double> &Conc();
-        Array::Array3<double> &Sfconc();
+        Array::Array4<conc_t, conc_alloc> &Conc();
+        Array::Array3<conc_t, conc_alloc> &Sfconc();
         Array::Array2<double> &Mask();
+        const MaskPyramid &Pyramid() const;
         double &FillValue();
 
     private:
         log4cplus::Logger logger;
         wacomm_data _data;
-        std::string &fileName;
+        std::string fileName;
+        std::shared_ptr<const wacomm_grid> grid;
 
         PointCloud cloud;
         KDTree* kdTree = nullptr;
 
-        double sgn(double a);
+        // netCDF is not thread safe and HDF5 serializes its calls anyway
+        static std::mutex ioMutex;
+
+        std::vector<size_t> chunkDims;
+        std::vector<int> chunkFilters;
+        size_t chunkTypeSize = 0;
+
+        void loadGrid(netCDF::NcFile &dataFile);
+        bool useGrid(wacomm_coords &coords, const std::function<bool(double *)> &readMask);
+        static uint64_t checksum(const Array::Array1<double> &depth, size_t dimDepth, const Array::Array1<double> &lat, const Array::Array1<double> &lon);
+        void groupCells(const std::vector<std::array<int, 2>> &cells, size_t tileLat, size_t tileLon, std::vector<wacomm_tile> &tiles);
+        bool readChunks(const std::vector<std::array<int, 2>> &cells, size_t &dimDepth, std::vector<wacomm_tile> &tiles);
+        bool decodeChunk(const std::vector<unsigned char> &raw, uint32_t filterMask, std::vector<unsigned char> &chunk);
+        void gatherCells(const std::vector<std::array<int, 2>> &cells, std::vector<float> &values);
+
+        template<typename T> void integrateLevels(float *field);
+
+        bool locate(double lat, double lon, double &j, double &i, cell_hint &hint) const;
+        bool locateCell(const double *query, double &j, double &i, cell_hint &hint) const;
+        bool nearestNode(const double *query, size_t &nearestIdx) const;
+
+        static double sgn(double a);
 };
 
 #endif //AIQUAMPLUSPLUS_WACOMMADAPTER_HPP
\ No newline at end of file